@@ -1,46 +1,181 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCHEDULE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+#include <errno.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <limits>
-#include <tuple>
-
-typedef char Carrier[3];        //  
-typedef char FlightNo[5];    //  
-typedef char Point[4];        //  
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+//     -  UTF-8:   (,   )   4 
+const int MAX_CHAR_BYTES = 4;
+const int CARRIER_CHARS = 2;
+const int FLIGHT_NO_CHARS = 4;
+const int POINT_CHARS = 3;
+//   : ,  ,  ,  , 
+const int FLIGHT_FIELDS = 5;
+
+const int FLIGHT_NO_BYTES = FLIGHT_NO_CHARS * MAX_CHAR_BYTES;
+
+typedef char Carrier[CARRIER_CHARS * MAX_CHAR_BYTES + 1];        //  
+typedef char FlightNo[FLIGHT_NO_BYTES + 1];    //  
+typedef char Point[POINT_CHARS * MAX_CHAR_BYTES + 1];        //  
 typedef long Fare;            // 
 const double CONST_DISCOUNT = 0.8;      //   
 
-//  
-struct RoutePoint {
-    RoutePoint *next;
-    Point point;
+//   (  ):     
+//  ,      
+class CodeTable {
+    //    16 ,  , -    
+    struct Slot {
+        unsigned long long key[2];
+        int id;                     // -1 -  
+    };
+
+    std::vector<Slot> slots;        //  ,  -  
+    std::vector<std::string> codes;
+
+public:
+    static const size_t MAX_BYTES = 16;
+
+    //    length  (  MAX_BYTES);      .
+    // readableEnd -    :      MAX_BYTES ,   
+    int intern(const char *code, size_t length, const char *readableEnd = 0);
+
+    int intern(const char *code);
+
+    //  , -1 -   
+    int find(const char *code, size_t length) const;
 
-    RoutePoint() : next(0) {}
+    int find(const char *code) const;
+
+    const char *code(int id) const;
+
+    int size() const;
+
+private:
+    //   key:    ,    
+    size_t lookup(const unsigned long long key[2]) const;
+};
+
+// ,      
+class MappedFile {
+    const char *data;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+
+public:
+    MappedFile();
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    int open(const char *fileName);    // 0 - OK, !=0 - 
+
+    const char *begin() const;
+
+    const char *end() const;
+};
+
+//      (stdout, ):    
+//         flush
+class OutputBuffer {
+    int fd;
+    std::vector<char> data;
+    size_t used;
+
+public:
+    static const size_t CAPACITY = 1 << 16;
+
+    explicit OutputBuffer(int fd);
+
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer &) = delete;
+
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    void write(const char *text, size_t size);
+
+    void print(const char *format, ...);    //  printf
+
+    int flush();    // 0 - OK, !=0 -  
+};
+
+//     .     
+//  pending: ,   ,     
+class LineReader {
+    int fd;
+    OutputBuffer *pending;
+    std::vector<char> data;
+    size_t begin, end;
+    bool eof;
+
+public:
+    LineReader(int fd, OutputBuffer *pending);
+
+    //   [line, lineEnd)   ,    ;
+    // false -  
+    bool next(const char *&line, const char *&lineEnd);
 };
 
 // 
 class Route {
-    RoutePoint *first;
+    std::vector<int> points;            //    
+    const CodeTable *pointCodes;
 
 public:
     Route();
 
-    ~Route();
+    //   ,     pointCodes
+    int read(const char *fileName, CodeTable &pointCodes);    // 0 - OK, !=0 - 
 
-    //   
-    int read(const char *fileName);    // 0 - OK, !=0 - 
+    //      [begin, end),     pointCodes;
+    // 0 - OK,   
+    const char *parse(const char *begin, const char *end, const CodeTable &pointCodes);
 
     //   :
     //     
     //        
     int check() const;    // 0 - OK, !=0 - 
 
-    // 
-    RoutePoint *iterator(RoutePoint *&iter) const;
+    const std::vector<int> &getPoints() const;
 
-    //   stdout
-    void print(const char *prefix) const;
+    void print(OutputBuffer &out, const char *prefix) const;
 };
 
 // 
@@ -51,345 +186,1669 @@ struct Flight {
     Point arrPoint;    //  
     Fare fare;            // 
 
-    void print() const;
+    void print(OutputBuffer &out) const;
 };
 
-//
-class ScheduleItem : public Flight {
-    friend class Schedule;
+// ,     .      ,
+//    ,       
+struct ScheduleChunk {
+    CodeTable points;
+    CodeTable carriers;
 
-    ScheduleItem *next;
+    std::vector<int> depPoints;
+    std::vector<int> arrPoints;
+    std::vector<int> carrierIds;
+    std::vector<char> flightNos;    //  FLIGHT_NO_BYTES   ,  
+    std::vector<Fare> fares;
 
-public:
-    ScheduleItem() : next(0) {}
+    int lines;                                          //    
+    std::vector<std::pair<int, std::string>> errors;    // <   , >
+
+    ScheduleChunk() : lines(0) {}
+
+    //   [begin, end)
+    void parse(const char *begin, const char *end);
+
+private:
+    //      p   ; 0 - OK (  ),   
+    const char *parseLine(const char *&p, const char *end);
+
+    //      . ascii -     ASCII,
+    // end -    
+    const char *addFlight(const char *const field[], const char *const fieldEnd[], bool ascii, const char *end);
+};
+
+//      
+struct CarrierFlight {
+    int carrier;
+    int flight;
+    Fare fare;
+};
+
+//    ( )
+struct LegFlights {
+    int cheapest;               //    
+    //    ,    . ,    
+    // :     ,     
+    CarrierFlight *flights;
+    int count;
+
+    LegFlights() : cheapest(-1), flights(0), count(0) {}
+
+    //      , -1 -    
+    int find(int carrier) const;
 };
 
-// 
+// .          ,
+//    -  
 class Schedule {
-    ScheduleItem *firstFlight;
+    CodeTable &points;
+    CodeTable carriers;
+
+    std::vector<int> depPoints;
+    std::vector<int> arrPoints;
+    std::vector<int> carrierIds;
+    std::vector<char> flightNos;    //  FLIGHT_NO_BYTES   ,  
+    std::vector<Fare> fares;
+
 public:
-    Schedule();
+    //     
+    explicit Schedule(CodeTable &points);
+
+    //   ,   .      , 
+    //   threads .     stderr  
+    int read(const char *fileName, int threads = 1);    // 0 - OK, !=0 - 
+
+    int size() const;
 
-    ~Schedule();
+    //     ( )
+    Flight flight(int id) const;
 
-    //   
-    int read(const char *fileName);    // 0 - OK, !=0 - 
+    Fare fare(int id) const;
 
-    // 
-    ScheduleItem *iterator(ScheduleItem *&iter) const;
+    //  ;   -  0  carrierCount() - 1
+    int carrierCount() const;
 
-    //   stdout
-    void print() const;
+    //    , -1 -    
+    int findCarrier(const char *code) const;
 
+    //   depPoint -> arrPoint, 0 -   
+    const LegFlights *findLeg(int depPoint, int arrPoint) const;
+
+    void print(OutputBuffer &out) const;
+
+private:
+    //     ,     
+    void append(const ScheduleChunk &chunk);
+
+    //       ,   - O(1)
+    void buildIndex();
+
+    std::unordered_map<unsigned long long, LegFlights> legs;
+    //   ,    LegFlights::flights
+    std::vector<CarrierFlight> legFlights;
 };
 
-//  
-struct TransLeg {
-    TransLeg *next;
-    Flight flight;
+//   -      .  
+//  ,      ,       :
+//        
+class DiscountRule {
+public:
+    virtual ~DiscountRule() {}
+
+    //  ; 0 - ,   
+    virtual int stateCount() const = 0;
+
+    //   :      ,     
+    enum { OUTSIDE = -1 };
+
+    //  ,  0  groupLimit(carriers) - 1,  OUTSIDE
+    virtual int group(int carrier) const = 0;
 
-    TransLeg() : next(0) {}
+    //   ,    carriers 
+    virtual int groupLimit(int carriers) const = 0;
+
+    //   ; sameGroup -   ,     (  - false)
+    virtual int next(int state, bool sameGroup) const = 0;
+
+    //   ,      state
+    virtual double legFactor(int state) const = 0;
+
+    //   ,   state
+    virtual double routeFactor(int state) const = 0;
+};
+
+typedef std::vector<const DiscountRule *> DiscountRules;
+
+//  factor  ,    (  )    .
+// eachCarrier -     :     .
+//    addGroup,          
+class GroupRule : public DiscountRule {
+    enum { START, ONE_LEG, SAME_GROUP, MIXED, STATES };
+
+    double factor;
+    bool eachCarrier;
+    std::vector<int> groupOf;   //  , OUTSIDE -   
+    int groups;
+
+public:
+    GroupRule(double factor, bool eachCarrier);
+
+    //    carriers (, )
+    void addGroup(const std::vector<int> &carriers);
+
+    int stateCount() const override;
+    int group(int carrier) const override;
+    int groupLimit(int carriers) const override;
+    int next(int state, bool sameGroup) const override;
+    double legFactor(int state) const override;
+    double routeFactor(int state) const override;
+};
+
+//  factor   ,   k-    
+class ConsecutiveRule : public DiscountRule {
+    int k;
+    double factor;
+
+public:
+    ConsecutiveRule(int k, double factor);    // k >= 1
+
+    //  -      ,   k
+    int stateCount() const override;
+    int group(int carrier) const override;
+    int groupLimit(int carriers) const override;
+    int next(int state, bool sameGroup) const override;
+    double legFactor(int state) const override;
+    double routeFactor(int state) const override;
+};
+
+//   :    -  CONST_DISCOUNT
+const DiscountRules &defaultRules();
+
+//    .        ;  
+//       (, ,  ),
+//    -   .   
+//    ,      ;   
+class Pricer {
+    //     <, , >
+    struct Node {
+        double cost;
+        int back;       //   , -1 - 
+    };
+
+    //        (  )
+    struct Best {
+        double cost;
+        int node;
+        int group;
+    };
+
+    const DiscountRules *rules;
+    std::vector<const LegFlights *> routeLegs;
+    std::vector<size_t> legNodes;       //     nodes
+    std::vector<Node> nodes;            //  stateCount()    
+    std::vector<Best> byGroup;          // [ * stateCount() + ]
+    std::vector<Best> top;              //   : [ * 2], [ * 2 + 1]
+    std::vector<int> groups;            //   ,    / stateCount()
+    //    ,      
+    std::vector<int> nextSame, nextOther;
+    std::vector<double> legFactors, routeFactors;
+    // ,      :   
+    std::vector<int> live, nextLive;
+    std::vector<char> liveMark;
+
+public:
+    explicit Pricer(const DiscountRules &rules = defaultRules());
+
+    //     count :      flights (count - 1 ),
+    //   total
+    int price(const int *points, int count, const Schedule &schedule, int *flights, double &total);    // 0 - OK
+
+private:
+    //     rule;    total -   flights  total
+    void priceRule(const DiscountRule &rule, const Schedule &schedule, int *flights, double &total);
 };
 
 // 
 class Transportation {
-    TransLeg *firstLeg;
+    const Schedule *schedule;
+    std::vector<int> legs;      //    
     double total_fare;
+    Pricer pricer;
 public:
-    Transportation();
-
-    ~Transportation();
+    explicit Transportation(const DiscountRules &rules = defaultRules());
 
     void flush();
 
     int buildCheapest(const Route &route, const Schedule &schedule);
 
-    void print() const;
+    void print(OutputBuffer &out) const;
+};
+
+//    ,    
+class TransportationBatch {
+    const Schedule *schedule;
+    std::vector<size_t> offsets;    //   i - flights[offsets[i]] .. flights[offsets[i + 1] - 1]
+    std::vector<int> flights;
+    std::vector<double> fares;
+    std::vector<char> built;        // 0 -     
+
+public:
+    TransportationBatch();
+
+    //   threads .    ,      ;
+    //        
+    void build(const std::vector<Route> &routes, const Schedule &schedule, int threads,
+               const DiscountRules &rules = defaultRules());
+
+    size_t size() const;
+
+    bool isBuilt(size_t route) const;
+
+    double totalFare(size_t route) const;
+
+    void print(size_t route, OutputBuffer &out) const;
 
 private:
-    std::unordered_map<std::string, Flight *> findLegFlight(const Schedule &schedule,
-                                                            const char *depPoint,
-                                                            const char *arrPoint);
+    void buildRange(const std::vector<Route> &routes, size_t begin, size_t end, Pricer &pricer);
 };
 
 //___  _________________________________
 
-//___ Route ______________________________________
+//___ CodeTable __________________________________
+
+//     length - MAX_BYTES ,   KEY_MASK + MAX_BYTES - length
+static const unsigned char KEY_MASK[2 * CodeTable::MAX_BYTES] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static void packCode(const char *code, size_t length, const char *readableEnd, unsigned long long key[2]) {
+    if (readableEnd && (size_t) (readableEnd - code) >= CodeTable::MAX_BYTES) {
+        //     ,    
+        unsigned long long mask[2];
+        memcpy(key, code, CodeTable::MAX_BYTES);
+        memcpy(mask, KEY_MASK + CodeTable::MAX_BYTES - length, CodeTable::MAX_BYTES);
+        key[0] &= mask[0];
+        key[1] &= mask[1];
+        return;
+    }
+    char bytes[CodeTable::MAX_BYTES] = {};
+    memcpy(bytes, code, length);
+    memcpy(key, bytes, CodeTable::MAX_BYTES);
+}
 
-Route::Route()
-        : first(0) {
+size_t CodeTable::lookup(const unsigned long long key[2]) const {
+    const size_t mask = slots.size() - 1;
+    unsigned long long hash = (key[0] ^ key[1] * 0xC2B2AE3D27D4EB4FULL) * 0x9E3779B97F4A7C15ULL;
+    for (size_t i = (size_t) (hash >> 32) & mask;; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if (slot.id < 0 || (slot.key[0] == key[0] && slot.key[1] == key[1]))
+            return i;
+    }
 }
 
-Route::~Route() {
-    for (RoutePoint *item = first; item;) {
-        RoutePoint *toDelete = item;
-        item = item->next;
-        delete toDelete;
+int CodeTable::intern(const char *code, size_t length, const char *readableEnd) {
+    //     -   
+    if (2 * (codes.size() + 1) > slots.size()) {
+        std::vector<Slot> old(std::max<size_t>(16, 2 * slots.size()), Slot{{0, 0}, -1});
+        old.swap(slots);
+        for (const Slot &slot : old) {
+            if (slot.id >= 0)
+                slots[lookup(slot.key)] = slot;
+        }
+    }
+
+    unsigned long long key[2];
+    packCode(code, length, readableEnd, key);
+    Slot &slot = slots[lookup(key)];
+    if (slot.id < 0) {
+        slot = Slot{{key[0], key[1]}, (int) codes.size()};
+        codes.emplace_back(code, length);
     }
+    return slot.id;
 }
 
-int Route::read(const char *fileName) {
-    RoutePoint *lastItem = 0;
+int CodeTable::intern(const char *code) {
+    return intern(code, strlen(code));
+}
+
+int CodeTable::find(const char *code, size_t length) const {
+    if (slots.empty() || length > MAX_BYTES)
+        return -1;
+    unsigned long long key[2];
+    packCode(code, length, 0, key);
+    return slots[lookup(key)].id;
+}
+
+int CodeTable::find(const char *code) const {
+    return find(code, strlen(code));
+}
+
+const char *CodeTable::code(int id) const {
+    return codes[id].c_str();
+}
+
+int CodeTable::size() const {
+    return (int) codes.size();
+}
 
-    FILE *f = fopen(fileName, "r");
-    if (!f) return 1;
+//___ MappedFile _________________________________
 
-    Point readPoint;
-    while (fscanf(f, "%3s", readPoint) == 1) {
-        RoutePoint *newItem = new RoutePoint;
-        strcpy(newItem->point, readPoint);
-        if (lastItem) {
-            lastItem->next = newItem;
-        } else
-            first = newItem;
-        lastItem = newItem;
+MappedFile::MappedFile()
+        : data(0), length(0) {
+#ifdef _WIN32
+    file = INVALID_HANDLE_VALUE;
+    mapping = 0;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (data)
+        UnmapViewOfFile(data);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+#else
+    if (data)
+        munmap((void *) data, length);
+#endif
+}
+
+int MappedFile::open(const char *fileName) {
+#ifdef _WIN32
+    file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE) return 1;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) return 1;
+    length = (size_t) size.QuadPart;
+    if (length == 0) return 0;    //    
+    mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    if (!mapping) return 1;
+    data = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    return data ? 0 : 1;
+#else
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return 1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 1;
+    }
+    length = (size_t) st.st_size;
+    if (length == 0) {    //    
+        close(fd);
+        return 0;
     }
+    void *mapped = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return 1;
+    madvise(mapped, length, MADV_SEQUENTIAL);
+    data = (const char *) mapped;
+    return 0;
+#endif
+}
+
+const char *MappedFile::begin() const {
+    return data;
+}
+
+const char *MappedFile::end() const {
+    return data + length;
+}
 
-    fclose(f);
+//___ - __________________________________
+
+//  size  ; 0 - OK
+static int writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        int written = _write(fd, data, (unsigned) std::min<size_t>(size, 1 << 30));
+#else
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+#endif
+        if (written <= 0) return 1;
+        data += written;
+        size -= (size_t) written;
+    }
+    return 0;
+}
+
+//   , 0 -  , <0 - 
+static long readSome(int fd, char *data, size_t size) {
+#ifdef _WIN32
+    return _read(fd, data, (unsigned) std::min<size_t>(size, 1 << 30));
+#else
+    for (;;) {
+        ssize_t count = ::read(fd, data, size);
+        if (count >= 0 || errno != EINTR)
+            return (long) count;
+    }
+#endif
+}
+
+OutputBuffer::OutputBuffer(int fd)
+        : fd(fd), data(CAPACITY), used(0) {
+}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+void OutputBuffer::write(const char *text, size_t size) {
+    if (used + size > data.size())
+        flush();
+    if (size >= data.size()) {
+        writeAll(fd, text, size);
+        return;
+    }
+    memcpy(data.data() + used, text, size);
+    used += size;
+}
+
+void OutputBuffer::print(const char *format, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(data.data() + used, data.size() - used, format, args);
+        va_end(args);
+        if (length < 0) return;
+        if ((size_t) length < data.size() - used) {
+            used += (size_t) length;
+            return;
+        }
+        //  :  ,       
+        if (used > 0)
+            flush();
+        else
+            data.resize((size_t) length + 1);
+    }
+}
+
+int OutputBuffer::flush() {
+    int result = writeAll(fd, data.data(), used);
+    used = 0;
+    return result;
+}
+
+LineReader::LineReader(int fd, OutputBuffer *pending)
+        : fd(fd), pending(pending), data(OutputBuffer::CAPACITY), begin(0), end(0), eof(false) {
+}
+
+bool LineReader::next(const char *&line, const char *&lineEnd) {
+    for (;;) {
+        const char *newline = (const char *) memchr(data.data() + begin, '\n', end - begin);
+        if (newline) {
+            line = data.data() + begin;
+            lineEnd = newline;
+            begin = (size_t) (newline - data.data()) + 1;
+            return true;
+        }
+        if (eof) {
+            if (begin == end) return false;
+            //     
+            line = data.data() + begin;
+            lineEnd = data.data() + end;
+            begin = end;
+            return true;
+        }
+
+        //      ,    
+        memmove(data.data(), data.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        if (end == data.size())
+            data.resize(2 * data.size());
+
+        if (pending && pending->flush())
+            eof = true;     //   :   
+        long count = eof ? 0 : readSome(fd, data.data() + end, data.size() - end);
+        if (count <= 0)
+            eof = true;
+        else
+            end += (size_t) count;
+    }
+}
+
+//___   _______________________________
+
+//   UTF-8  [begin, end), -1 -   
+static int codePoints(const char *begin, const char *end) {
+    int count = 0;
+    for (const unsigned char *p = (const unsigned char *) begin; p < (const unsigned char *) end; count++) {
+        unsigned char c = *p++;
+        int extra = c < 0x80 ? 0 : (c & 0xE0) == 0xC0 ? 1 : (c & 0xF0) == 0xE0 ? 2 : (c & 0xF8) == 0xF0 ? 3 : -1;
+        if (extra < 0 || (const unsigned char *) end - p < extra)
+            return -1;
+        for (; extra > 0; extra--) {
+            if ((*p++ & 0xC0) != 0x80)
+                return -1;
+        }
+    }
+    return count;
+}
+
+//   [begin, end) -  1  maxChars  UTF-8; ascii -  ,    ASCII
+static bool isCode(const char *begin, const char *end, int maxChars, bool ascii) {
+    int chars = ascii ? (int) (end - begin) : codePoints(begin, end);
+    return chars >= 1 && chars <= maxChars;
+}
+
+// :    ;  UTF-8  ASCII    
+static bool isBlank(char c) {
+    return (unsigned char) c <= ' ';
+}
+
+//    [p, end) -  ; false -   
+static bool nextWord(const char *&p, const char *end, const char *&word) {
+    while (p < end && isBlank(*p))
+        p++;
+    word = p;
+    while (p < end && !isBlank(*p))
+        p++;
+    return word < p;
+}
+
+//       width :  UTF-8    
+static void printCode(OutputBuffer &out, const char *code, int width) {
+    size_t length = strlen(code);
+    out.write(code, length);
+    for (int chars = codePoints(code, code + length); chars < width; chars++)
+        out.write(" ", 1);
+}
+
+//___ Route ______________________________________
+
+Route::Route()
+        : pointCodes(0) {
+}
+
+int Route::read(const char *fileName, CodeTable &codes) {
+    MappedFile file;
+    if (file.open(fileName)) return 1;
+
+    pointCodes = &codes;
+    points.clear();
+    const char *code;
+    for (const char *p = file.begin(); nextWord(p, file.end(), code);) {
+        if (!isCode(code, p, POINT_CHARS, false)) {
+            fprintf(stderr, "%s: invalid point code '%.*s'\n", fileName, (int) (p - code), code);
+            return 1;
+        }
+        points.push_back(codes.intern(code, p - code));
+    }
     return 0;
 }
 
 int Route::check() const {
-    if (!first || !first->next)
+    if (points.size() < 2)
         return 1;
 
-    RoutePoint *iter = 0;
-    while (iterator(iter)) {
-        if (iter->next && 0 == strcmp(iter->point, iter->next->point))
+    for (size_t i = 1; i < points.size(); i++) {
+        if (points[i - 1] == points[i])
             return 1;
     }
     return 0;
 }
 
-RoutePoint *Route::iterator(RoutePoint *&iter) const {
-    if (iter)
-        iter = iter->next;
-    else
-        iter = first;
-    return iter;
+const char *Route::parse(const char *begin, const char *end, const CodeTable &codes) {
+    pointCodes = &codes;
+    points.clear();
+    const char *code;
+    for (const char *p = begin; nextWord(p, end, code);) {
+        if (!isCode(code, p, POINT_CHARS, false))
+            return "invalid point code";
+        int point = codes.find(code, p - code);
+        if (point < 0)
+            return "unknown point";
+        points.push_back(point);
+    }
+    return 0;
+}
+
+const std::vector<int> &Route::getPoints() const {
+    return points;
 }
 
-void Route::print(const char *prefix) const {
+void Route::print(OutputBuffer &out, const char *prefix) const {
     if (prefix)
-        printf(prefix);
+        out.write(prefix, strlen(prefix));
 
-    RoutePoint *iter = 0;
-    while (iterator(iter)) {
-        printf("%s ", iter->point);
+    for (int point : points) {
+        out.print("%s ", pointCodes->code(point));
     }
 
-    printf("\n");
+    out.write("\n", 1);
 }
 
 //___  ___________________________________________
 
-void Flight::print() const {
-    printf("%-2s %-4s %-3s %-3s %10ld",
-           carrier,
-           flightNo,
-           depPoint,
-           arrPoint,
-           fare);
+int LegFlights::find(int carrier) const {
+    const CarrierFlight *end = flights + count;
+    const CarrierFlight *it = std::lower_bound((const CarrierFlight *) flights, end, carrier,
+                                               [](const CarrierFlight &entry, int c) { return entry.carrier < c; });
+    if (it == end || it->carrier != carrier)
+        return -1;
+    return it->flight;
+}
+
+void Flight::print(OutputBuffer &out) const {
+    printCode(out, carrier, CARRIER_CHARS);
+    out.write(" ", 1);
+    printCode(out, flightNo, FLIGHT_NO_CHARS);
+    out.write(" ", 1);
+    printCode(out, depPoint, POINT_CHARS);
+    out.write(" ", 1);
+    printCode(out, arrPoint, POINT_CHARS);
+    out.print(" %10ld", fare);
+}
+
+#ifdef SCHEDULE_SSE2
+//    , mask != 0
+static int lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int) index;
+#else
+    return __builtin_ctz(mask);
+#endif
 }
 
-Schedule::Schedule()
-        : firstFlight(0) {
+//   ,   p ( p    32 ).   
+//     32 ,   -     ,
+//     . ascii -     ASCII. 0 -   31 
+//     FLIGHT_FIELDS :    
+static const char *splitFields(const char *p, const char *field[], const char *fieldEnd[], bool &ascii) {
+    //          0x80
+    const __m128i bias = _mm_set1_epi8((char) 0x80);
+    const __m128i blankLimit = _mm_set1_epi8((char) ((' ' + 1) ^ 0x80));
+    const __m128i newline = _mm_set1_epi8('\n');
+    unsigned blanks = 0;
+    unsigned newlines = 0;
+    unsigned high = 0;
+    for (int half = 0; half < 2; half++) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (p + 16 * half));
+        high |= (unsigned) _mm_movemask_epi8(bytes) << (16 * half);
+        blanks |= (unsigned) _mm_movemask_epi8(_mm_cmplt_epi8(_mm_xor_si128(bytes, bias), blankLimit)) << (16 * half);
+        newlines |= (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << (16 * half);
+    }
+    if (!newlines)
+        return 0;
+
+    const int length = lowestBit(newlines);
+    const unsigned line = (1u << length) - 1;
+    const unsigned token = ~blanks & line;
+    ascii = !(high & line);
+    unsigned starts = token & ~(token << 1);
+    unsigned ends = token & ~(token >> 1);
+    for (int i = 0; i < FLIGHT_FIELDS; i++) {
+        if (!starts)
+            return 0;
+        field[i] = p + lowestBit(starts);
+        fieldEnd[i] = p + lowestBit(ends) + 1;
+        starts &= starts - 1;
+        ends &= ends - 1;
+    }
+    return starts ? 0 : p + length;
+}
+#endif
+
+void ScheduleChunk::parse(const char *begin, const char *end) {
+    for (const char *p = begin; p < end; p++) {
+        lines++;
+        const char *error;
+        const char *lineEnd = 0;
+        const char *field[FLIGHT_FIELDS];
+        const char *fieldEnd[FLIGHT_FIELDS];
+        bool ascii = false;
+#ifdef SCHEDULE_SSE2
+        if (end - p >= 32)
+            lineEnd = splitFields(p, field, fieldEnd, ascii);
+#endif
+        if (lineEnd) {
+            error = addFlight(field, fieldEnd, ascii, end);
+            p = lineEnd;
+        } else {
+            error = parseLine(p, end);
+        }
+        if (error) {
+            errors.emplace_back(lines, error);
+            //    
+            p = (const char *) memchr(p, '\n', end - p);
+            if (!p)
+                break;
+        }
+    }
 }
 
-Schedule::~Schedule() {
-    for (ScheduleItem *flight = firstFlight; flight;) {
-        ScheduleItem *toDelete = flight;
-        flight = flight->next;
-        delete toDelete;
+const char *ScheduleChunk::parseLine(const char *&p, const char *end) {
+    const char *field[FLIGHT_FIELDS];
+    const char *fieldEnd[FLIGHT_FIELDS];
+    int count = 0;
+    for (;;) {
+        while (p < end && isBlank(*p) && *p != '\n')
+            p++;
+        if (p == end || *p == '\n')
+            break;
+        if (count == FLIGHT_FIELDS)
+            return "too many fields";
+        field[count] = p;
+        while (p < end && !isBlank(*p))
+            p++;
+        fieldEnd[count++] = p;
     }
+    if (count == 0)
+        return 0;    //  
+    if (count < FLIGHT_FIELDS)
+        return "expected 5 fields: carrier, flight number, departure, arrival, fare";
+    return addFlight(field, fieldEnd, false, end);
 }
 
-int Schedule::read(const char *fileName) {
-    ScheduleItem *lastFlight = 0;
+const char *ScheduleChunk::addFlight(const char *const field[], const char *const fieldEnd[], bool ascii,
+                                     const char *end) {
+    if (!isCode(field[0], fieldEnd[0], CARRIER_CHARS, ascii))
+        return "carrier code must be 1-2 characters";
+    if (!isCode(field[1], fieldEnd[1], FLIGHT_NO_CHARS, ascii))
+        return "flight number must be 1-4 characters";
+    if (!isCode(field[2], fieldEnd[2], POINT_CHARS, ascii) || !isCode(field[3], fieldEnd[3], POINT_CHARS, ascii))
+        return "point code must be 1-3 characters";
+
+    //   digits10     Fare
+    if (fieldEnd[4] - field[4] > std::numeric_limits<Fare>::digits10)
+        return "fare is too large";
+    Fare fare = 0;
+    for (const char *d = field[4]; d < fieldEnd[4]; d++) {
+        if (*d < '0' || *d > '9')
+            return "fare must be a non-negative integer";
+        fare = fare * 10 + (*d - '0');
+    }
+
+    carrierIds.push_back(carriers.intern(field[0], fieldEnd[0] - field[0], end));
+    //    ,    ,   
+    flightNos.resize(flightNos.size() + FLIGHT_NO_BYTES);
+    memcpy(&flightNos[flightNos.size() - FLIGHT_NO_BYTES], field[1], fieldEnd[1] - field[1]);
+    depPoints.push_back(points.intern(field[2], fieldEnd[2] - field[2], end));
+    arrPoints.push_back(points.intern(field[3], fieldEnd[3] - field[3], end));
+    fares.push_back(fare);
+    return 0;
+}
 
-    FILE *f = fopen(fileName, "r");
-    if (!f) return 1;
+Schedule::Schedule(CodeTable &points)
+        : points(points) {
+}
 
+int Schedule::read(const char *fileName, int threads) {
+    MappedFile file;
+    if (file.open(fileName)) return 1;
+
+    //    ,  -   
+    const size_t MIN_CHUNK = 1 << 20;
+    const size_t length = file.end() - file.begin();
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threads, length / MIN_CHUNK));
+    std::vector<const char *> bounds(1, file.begin());
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char *bound = std::max(bounds.back(), file.begin() + length * i / chunkCount);
+        const char *lineEnd = (const char *) memchr(bound, '\n', file.end() - bound);
+        bounds.push_back(lineEnd ? lineEnd + 1 : file.end());
+    }
+    bounds.push_back(file.end());
+
+    std::vector<ScheduleChunk> chunks(chunkCount);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunkCount; i++)
+        workers.emplace_back([&chunks, &bounds, i] { chunks[i].parse(bounds[i], bounds[i + 1]); });
+    chunks[0].parse(bounds[0], bounds[1]);
+    for (std::thread &worker : workers)
+        worker.join();
+
+    //        
+    int errors = 0;
+    int firstLine = 0;
+    for (const ScheduleChunk &chunk : chunks) {
+        for (const auto &[line, error] : chunk.errors)
+            fprintf(stderr, "%s:%d: %s\n", fileName, firstLine + line, error.c_str());
+        errors += (int) chunk.errors.size();
+        firstLine += chunk.lines;
+        append(chunk);
+    }
+    if (errors) return 1;
+
+    buildIndex();
+    return 0;
+}
+
+void Schedule::append(const ScheduleChunk &chunk) {
+    std::vector<int> pointIds, carrierIdsOf;
+    for (int id = 0; id < chunk.points.size(); id++)
+        pointIds.push_back(points.intern(chunk.points.code(id)));
+    for (int id = 0; id < chunk.carriers.size(); id++)
+        carrierIdsOf.push_back(carriers.intern(chunk.carriers.code(id)));
+
+    for (size_t i = 0; i < chunk.fares.size(); i++) {
+        depPoints.push_back(pointIds[chunk.depPoints[i]]);
+        arrPoints.push_back(pointIds[chunk.arrPoints[i]]);
+        carrierIds.push_back(carrierIdsOf[chunk.carrierIds[i]]);
+    }
+    flightNos.insert(flightNos.end(), chunk.flightNos.begin(), chunk.flightNos.end());
+    fares.insert(fares.end(), chunk.fares.begin(), chunk.fares.end());
+}
+
+//  :      
+static unsigned long long legKey(int depPoint, int arrPoint) {
+    return (unsigned long long) (unsigned) depPoint << 32 | (unsigned) arrPoint;
+}
+
+void Schedule::buildIndex() {
+    legs.clear();
+
+    //  :        
+    const int flightCount = size();
+    std::vector<LegFlights *> flightLeg(flightCount);
+    for (int id = 0; id < flightCount; id++) {
+        LegFlights &leg = legs[legKey(depPoints[id], arrPoints[id])];
+        leg.count++;
+        flightLeg[id] = &leg;
+    }
+
+    //     ;  assign   
+    legFlights.assign(flightCount, CarrierFlight{0, 0, 0});
+    int offset = 0;
+    for (auto &[key, leg] : legs) {
+        leg.flights = legFlights.data() + offset;
+        offset += leg.count;
+        leg.count = 0;
+    }
+    for (int id = 0; id < flightCount; id++) {
+        LegFlights *leg = flightLeg[id];
+        leg->flights[leg->count++] = CarrierFlight{carrierIds[id], id, fares[id]};
+    }
+
+    //       ,    (   - )
+    for (auto &[key, leg] : legs) {
+        CarrierFlight *last = leg.flights + leg.count;
+        std::sort(leg.flights, last, [](const CarrierFlight &a, const CarrierFlight &b) {
+            if (a.carrier != b.carrier) return a.carrier < b.carrier;
+            if (a.fare != b.fare) return a.fare < b.fare;
+            return a.flight < b.flight;
+        });
+        last = std::unique(leg.flights, last, [](const CarrierFlight &a, const CarrierFlight &b) {
+            return a.carrier == b.carrier;
+        });
+        leg.count = (int) (last - leg.flights);
+
+        const CarrierFlight *cheapest = leg.flights;
+        for (int i = 1; i < leg.count; i++) {
+            if (leg.flights[i].fare < cheapest->fare)
+                cheapest = &leg.flights[i];
+        }
+        leg.cheapest = cheapest->flight;
+    }
+}
+
+int Schedule::size() const {
+    return (int) fares.size();
+}
+
+Flight Schedule::flight(int id) const {
     Flight fl;
-    while (fscanf(f, "%2s %4s %3s %3s %ld", fl.carrier, fl.flightNo, fl.depPoint, fl.arrPoint, &fl.fare) == 5) {
-        ScheduleItem *newFlight = new ScheduleItem;
-        *(Flight *) newFlight = fl;
-        if (lastFlight) {
-            lastFlight->next = newFlight;
-        } else
-            firstFlight = newFlight;
-        lastFlight = newFlight;
+    strcpy(fl.carrier, carriers.code(carrierIds[id]));
+    memcpy(fl.flightNo, &flightNos[id * FLIGHT_NO_BYTES], FLIGHT_NO_BYTES);
+    fl.flightNo[FLIGHT_NO_BYTES] = 0;
+    strcpy(fl.depPoint, points.code(depPoints[id]));
+    strcpy(fl.arrPoint, points.code(arrPoints[id]));
+    fl.fare = fares[id];
+    return fl;
+}
+
+Fare Schedule::fare(int id) const {
+    return fares[id];
+}
+
+int Schedule::carrierCount() const {
+    return carriers.size();
+}
+
+int Schedule::findCarrier(const char *code) const {
+    return carriers.find(code);
+}
+
+const LegFlights *Schedule::findLeg(int depPoint, int arrPoint) const {
+    auto it = legs.find(legKey(depPoint, arrPoint));
+    return it == legs.end() ? 0 : &it->second;
+}
+
+void Schedule::print(OutputBuffer &out) const {
+    for (int id = 0; id < size(); id++) {
+        flight(id).print(out);
+        out.write("\n", 1);
+    }
+}
+
+//___   ______________________________________________
+
+GroupRule::GroupRule(double factor, bool eachCarrier)
+        : factor(factor), eachCarrier(eachCarrier), groups(0) {
+}
+
+void GroupRule::addGroup(const std::vector<int> &carriers) {
+    for (int carrier : carriers) {
+        if (carrier >= (int) groupOf.size())
+            groupOf.resize(carrier + 1, OUTSIDE);
+        groupOf[carrier] = groups;
     }
+    groups++;
+}
+
+int GroupRule::stateCount() const {
+    return STATES;
+}
+
+int GroupRule::group(int carrier) const {
+    if (eachCarrier)
+        return carrier;
+    return carrier < (int) groupOf.size() ? groupOf[carrier] : OUTSIDE;
+}
+
+int GroupRule::groupLimit(int carriers) const {
+    return eachCarrier ? carriers : groups;
+}
 
-    fclose(f);
+int GroupRule::next(int state, bool sameGroup) const {
+    if (state == START)
+        return ONE_LEG;
+    return state != MIXED && sameGroup ? SAME_GROUP : MIXED;
+}
+
+double GroupRule::legFactor(int) const {
+    return 1;
+}
+
+double GroupRule::routeFactor(int state) const {
+    return state == SAME_GROUP ? factor : 1;
+}
+
+ConsecutiveRule::ConsecutiveRule(int k, double factor)
+        : k(std::max(k, 1)), factor(factor) {
+}
+
+int ConsecutiveRule::stateCount() const {
+    return k + 1;
+}
+
+int ConsecutiveRule::group(int carrier) const {
+    return carrier;
+}
+
+int ConsecutiveRule::groupLimit(int carriers) const {
+    return carriers;
+}
+
+int ConsecutiveRule::next(int state, bool sameGroup) const {
+    return state > 0 && sameGroup ? std::min(state + 1, k) : 1;
+}
+
+double ConsecutiveRule::legFactor(int state) const {
+    return state == k ? factor : 1;
+}
+
+double ConsecutiveRule::routeFactor(int) const {
+    return 1;
+}
+
+const DiscountRules &defaultRules() {
+    static const GroupRule singleCarrier(CONST_DISCOUNT, true);
+    static const DiscountRules rules = {&singleCarrier};
+    return rules;
+}
+
+//___ Pricer ______________________________________________________
+
+Pricer::Pricer(const DiscountRules &rules)
+        : rules(&rules) {
+}
+
+int Pricer::price(const int *points, int count, const Schedule &schedule, int *flights, double &total) {
+    routeLegs.clear();
+    for (int i = 0; i + 1 < count; i++) {
+        const LegFlights *leg = schedule.findLeg(points[i], points[i + 1]);
+        if (!leg) return 1;
+        routeLegs.push_back(leg);
+    }
+    if (routeLegs.empty()) return 1;
+
+    //   -     ;  ,  
+    Fare minFare = 0;
+    for (size_t l = 0; l < routeLegs.size(); l++) {
+        flights[l] = routeLegs[l]->cheapest;
+        minFare += schedule.fare(routeLegs[l]->cheapest);
+    }
+    total = minFare;
+
+    for (const DiscountRule *rule : *rules)
+        priceRule(*rule, schedule, flights, total);
     return 0;
 }
 
-ScheduleItem *Schedule::iterator(ScheduleItem *&iter) const {
-    if (iter)
-        iter = iter->next;
-    else
-        iter = firstFlight;
-    return iter;
+void Pricer::priceRule(const DiscountRule &rule, const Schedule &schedule, int *flights, double &total) {
+    const double NONE = std::numeric_limits<double>::infinity();
+    const int states = rule.stateCount();
+    const size_t groupSlots = (size_t) rule.groupLimit(schedule.carrierCount()) * states;
+    if (byGroup.size() < groupSlots)
+        byGroup.resize(groupSlots, Best{NONE, -1, -1});
+    top.resize(2 * states);
+    nextSame.resize(states);
+    nextOther.resize(states);
+    legFactors.resize(states);
+    routeFactors.resize(states);
+    for (int s = 0; s < states; s++) {
+        nextSame[s] = rule.next(s, true);
+        nextOther[s] = rule.next(s, false);
+        legFactors[s] = rule.legFactor(s);
+        routeFactors[s] = rule.routeFactor(s);
+    }
+
+    legNodes.clear();
+    groups.clear();
+    size_t nodeCount = 0;
+    for (const LegFlights *leg : routeLegs) {
+        legNodes.push_back(nodeCount);
+        nodeCount += (size_t) leg->count * states;
+        for (int i = 0; i < leg->count; i++)
+            groups.push_back(rule.group(leg->flights[i].carrier));
+    }
+    //      ,   
+    nodes.resize(nodeCount);
+
+    //  
+    const LegFlights *first = routeLegs[0];
+    const int firstState = nextOther[0];
+    for (int i = 0; i < first->count; i++)
+        nodes[(size_t) i * states + firstState] = Node{first->flights[i].fare * legFactors[firstState], -1};
+    live.assign(1, firstState);
+
+    for (size_t l = 1; l < routeLegs.size(); l++) {
+        const LegFlights *prev = routeLegs[l - 1];
+        const LegFlights *leg = routeLegs[l];
+        const size_t prevBase = legNodes[l - 1];
+        const size_t base = legNodes[l];
+
+        liveMark.assign(states, 0);
+        nextLive.clear();
+        for (int s : live) {
+            for (int state : {nextSame[s], nextOther[s]}) {
+                if (!liveMark[state]) {
+                    liveMark[state] = 1;
+                    nextLive.push_back(state);
+                }
+            }
+        }
+        for (int i = 0; i < leg->count; i++) {
+            for (int state : nextLive)
+                nodes[base + (size_t) i * states + state] = Node{NONE, -1};
+        }
+
+        //    :        
+        for (int s : live)
+            top[2 * s] = top[2 * s + 1] = Best{NONE, -1, -1};
+        const int *prevGroups = &groups[prevBase / states];
+        const int *legGroups = &groups[base / states];
+        for (int i = 0; i < prev->count; i++) {
+            const int group = prevGroups[i];
+            for (int s : live) {
+                const int node = (int) (prevBase + (size_t) i * states + s);
+                const double cost = nodes[node].cost;
+                if (cost == NONE)
+                    continue;
+                //        ,    -  
+                Best outside{cost, node, group};
+                Best &inGroup = group != DiscountRule::OUTSIDE ? byGroup[(size_t) group * states + s] : outside;
+                if (cost < inGroup.cost)
+                    inGroup = Best{cost, node, group};
+                Best *best = &top[2 * s];
+                if (best[0].group == group) {
+                    if (cost < best[0].cost)
+                        best[0] = inGroup;
+                } else if (cost < best[0].cost) {
+                    best[1] = best[0];
+                    best[0] = inGroup;
+                } else if (cost < best[1].cost) {
+                    best[1] = inGroup;
+                }
+            }
+        }
+
+        for (int i = 0; i < leg->count; i++) {
+            const int group = legGroups[i];
+            const Fare fare = leg->flights[i].fare;
+            Node *target = &nodes[base + (size_t) i * states];
+            for (int s : live) {
+                //         ;      
+                if (group == DiscountRule::OUTSIDE) {
+                    const Best &other = top[2 * s];
+                    if (other.node >= 0) {
+                        int state = nextOther[s];
+                        double cost = other.cost + fare * legFactors[state];
+                        if (cost < target[state].cost)
+                            target[state] = Node{cost, other.node};
+                    }
+                    continue;
+                }
+                const Best &same = byGroup[(size_t) group * states + s];
+                const Best &other = top[2 * s].group != group ? top[2 * s] : top[2 * s + 1];
+                if (same.node >= 0) {
+                    int state = nextSame[s];
+                    double cost = same.cost + fare * legFactors[state];
+                    if (cost < target[state].cost)
+                        target[state] = Node{cost, same.node};
+                }
+                if (other.node >= 0) {
+                    int state = nextOther[s];
+                    double cost = other.cost + fare * legFactors[state];
+                    if (cost < target[state].cost)
+                        target[state] = Node{cost, other.node};
+                }
+            }
+        }
+
+        //     ,  
+        for (int i = 0; i < prev->count; i++) {
+            if (prevGroups[i] == DiscountRule::OUTSIDE)
+                continue;
+            const size_t group = (size_t) prevGroups[i];
+            for (int s : live)
+                byGroup[group * states + s] = Best{NONE, -1, -1};
+        }
+        live.swap(nextLive);
+    }
+
+    //          
+    const size_t last = routeLegs.size() - 1;
+    std::sort(live.begin(), live.end());
+    int bestNode = -1;
+    double best = total;
+    for (int i = 0; i < routeLegs[last]->count; i++) {
+        for (int s : live) {
+            const size_t node = legNodes[last] + (size_t) i * states + s;
+            double cost = nodes[node].cost * routeFactors[s];
+            if (cost < best) {
+                best = cost;
+                bestNode = (int) node;
+            }
+        }
+    }
+    if (bestNode < 0)
+        return;
+
+    //     
+    total = best;
+    for (size_t l = last + 1; l-- > 0;) {
+        flights[l] = routeLegs[l]->flights[(bestNode - legNodes[l]) / states].flight;
+        bestNode = nodes[bestNode].back;
+    }
 }
 
-void Schedule::print() const {
-    ScheduleItem *f = 0;
-    while (iterator(f)) {
-        f->print();
-        printf("\n");
+//    count  flights
+static void printFlights(OutputBuffer &out, const Schedule &schedule, const int *flights, size_t count,
+                         double total) {
+    for (size_t legNo = 0; legNo < count; legNo++) {
+        out.print("% 2d: ", (int) legNo);
+        schedule.flight(flights[legNo]).print(out);
+        out.write("\n", 1);
     }
+    out.print("Total fare: %.4f\n", total); //format change
 }
 
 //___ Transportation ______________________________________________
 
-Transportation::Transportation()
-        : firstLeg(0), total_fare(0) {
+Transportation::Transportation(const DiscountRules &rules)
+        : schedule(0), total_fare(0), pricer(rules) {
 }
 
-Transportation::~Transportation() {
+void Transportation::flush() {
+    schedule = 0;
+    legs.clear();
+    total_fare = 0;
+}
+
+int Transportation::buildCheapest(const Route &route, const Schedule &schedule) {
     flush();
+
+    const std::vector<int> &points = route.getPoints();
+    if (points.size() < 2) return 1;
+    legs.resize(points.size() - 1);
+    if (pricer.price(points.data(), (int) points.size(), schedule, legs.data(), total_fare)) {
+        flush();
+        return 1;
+    }
+
+    this->schedule = &schedule;
+    return 0;
 }
 
-void Transportation::flush() {
-    for (TransLeg *leg = firstLeg; leg;) {
-        TransLeg *toDelete = leg;
-        leg = leg->next;
-        delete toDelete;
+void Transportation::print(OutputBuffer &out) const {
+    printFlights(out, *schedule, legs.data(), legs.size(), total_fare);
+}
+
+//___ TransportationBatch _________________________________________
+
+//   :    ,        
+const size_t BATCH_BLOCK = 64;
+
+//   -    [begin, end).     ,
+//     ;     
+struct alignas(64) BlockQueue {
+    std::mutex lock;
+    size_t begin = 0, end = 0;
+
+    //   ; false -  
+    bool pop(size_t &block) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (begin == end) return false;
+        block = begin++;
+        return true;
     }
-    firstLeg = 0;
-    total_fare = 0;
+
+    //      ; false -  
+    bool stealHalf(size_t &stolenBegin, size_t &stolenEnd) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (begin == end) return false;
+        stolenEnd = end;
+        stolenBegin = end - (end - begin + 1) / 2;
+        end = stolenBegin;
+        return true;
+    }
+};
+
+TransportationBatch::TransportationBatch()
+        : schedule(0) {
 }
 
-std::unordered_map<std::string, Flight *> Transportation::findLegFlight(const Schedule &schedule,
-                                                                        const char *depPoint,
-                                                                        const char *arrPoint) {
-    Flight *flightWithMinimalFare = 0;
-    std::unordered_map<std::string, Flight *> carrier_to_legs;
+void TransportationBatch::build(const std::vector<Route> &routes, const Schedule &schedule, int threads,
+                                const DiscountRules &rules) {
+    this->schedule = &schedule;
+
+    //       :       
+    offsets.assign(routes.size() + 1, 0);
+    for (size_t i = 0; i < routes.size(); i++)
+        offsets[i + 1] = offsets[i] + std::max<size_t>(routes[i].getPoints().size(), 1) - 1;
+    flights.assign(offsets.back(), -1);
+    fares.assign(routes.size(), 0);
+    built.assign(routes.size(), 0);
+
+    const size_t blocks = (routes.size() + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    const size_t queueCount = std::max<size_t>(1, std::min<size_t>(threads, blocks));
+    std::vector<BlockQueue> queues(queueCount);
+    for (size_t q = 0; q < queueCount; q++) {
+        queues[q].begin = blocks * q / queueCount;
+        queues[q].end = blocks * (q + 1) / queueCount;
+    }
 
-    ScheduleItem *schedItem = 0;
-    while (schedule.iterator(schedItem)) {
-        if (0 != strcmp(schedItem->depPoint, depPoint) ||
-            0 != strcmp(schedItem->arrPoint, arrPoint))
-            continue;
-        if (!flightWithMinimalFare || flightWithMinimalFare->fare > schedItem->fare) {
-            flightWithMinimalFare = schedItem;
-            carrier_to_legs["MinFare"] = schedItem;
+    auto work = [this, &routes, &rules, &queues, queueCount](size_t self) {
+        Pricer pricer(rules);
+        for (;;) {
+            size_t block;
+            if (!queues[self].pop(block)) {
+                //    - ,   
+                bool stolen = false;
+                for (size_t step = 1; step < queueCount && !stolen; step++) {
+                    size_t stolenBegin, stolenEnd;
+                    stolen = queues[(self + step) % queueCount].stealHalf(stolenBegin, stolenEnd);
+                    if (stolen) {
+                        std::lock_guard<std::mutex> guard(queues[self].lock);
+                        queues[self].begin = stolenBegin;
+                        queues[self].end = stolenEnd;
+                    }
+                }
+                if (!stolen) return;    //   :   
+                continue;
+            }
+            buildRange(routes, block * BATCH_BLOCK, std::min(routes.size(), (block + 1) * BATCH_BLOCK), pricer);
         }
-        carrier_to_legs[schedItem->carrier] = schedItem;
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t q = 1; q < queueCount; q++)
+        workers.emplace_back(work, q);
+    work(0);
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void TransportationBatch::buildRange(const std::vector<Route> &routes, size_t begin, size_t end, Pricer &pricer) {
+    for (size_t i = begin; i < end; i++) {
+        const std::vector<int> &points = routes[i].getPoints();
+        if (points.size() < 2)
+            continue;
+        built[i] = !pricer.price(points.data(), (int) points.size(), *schedule, &flights[offsets[i]], fares[i]);
     }
+}
 
-    return std::move(carrier_to_legs);
+size_t TransportationBatch::size() const {
+    return fares.size();
 }
 
-int Transportation::buildCheapest(const Route &route, const Schedule &schedule) {
-    RoutePoint *routePoint = 0;
-
-    //        ,       
-    //        carrier_transportation
-    // -  ,   fistLag,   lastLag
-    std::unordered_map<std::string, std::tuple<Fare, TransLeg *, TransLeg *>> carrier_transportation;
-
-    while (route.iterator(routePoint) && routePoint->next) {
-        std::unordered_map<std::string, Flight *> Legs = findLegFlight(schedule, routePoint->point,
-                                                                       routePoint->next->point);
-        if (Legs.empty()) return 1;
-
-        //
-        if (carrier_transportation.empty()) {
-            //       
-            for (const auto&[carrier, flight] : Legs) {
-                TransLeg *newLeg = new TransLeg;
-                newLeg->flight = *flight;
-                carrier_transportation[carrier] = std::make_tuple(newLeg->flight.fare, newLeg, newLeg);
-            }
-        } else {
-            for (auto it = carrier_transportation.begin(); it != carrier_transportation.end();) {
-                //     
-                // ,       -    
-                auto it_f = Legs.find(it->first);
-                if (it_f == Legs.end()) {
-                    it = carrier_transportation.erase(it);
+bool TransportationBatch::isBuilt(size_t route) const {
+    return built[route] != 0;
+}
+
+double TransportationBatch::totalFare(size_t route) const {
+    return fares[route];
+}
+
+void TransportationBatch::print(size_t route, OutputBuffer &out) const {
+    printFlights(out, *schedule, &flights[offsets[route]], offsets[route + 1] - offsets[route], fares[route]);
+}
+
+//___   ______________________________________________
+
+const int STDIN_FD = 0;
+const int STDOUT_FD = 1;
+
+//     in,     :    .
+//  -     ,    ,   "error: ";
+//     .    
+static void serveQueries(int in, int outFd, const Schedule &schedule, const CodeTable &points,
+                         const DiscountRules &rules) {
+    OutputBuffer out(outFd);
+    LineReader reader(in, &out);
+    Route route;
+    Transportation trans(rules);
+
+    const char *line, *lineEnd;
+    while (reader.next(line, lineEnd)) {
+        const char *word;
+        const char *p = line;
+        if (!nextWord(p, lineEnd, word))
+            continue;
+
+        const char *error = route.parse(line, lineEnd, points);
+        if (!error && route.check())
+            error = "route is invalid";
+        if (!error && trans.buildCheapest(route, schedule))
+            error = "cannot build transportation";
+
+        if (error)
+            out.print("error: %s\n", error);
+        else
+            trans.print(out);
+        out.write("\n", 1);
+    }
+}
+
+//    ;     listen
+const int SOCKET_CLIENTS = 32;
+
+//    unix- path.   SOCKET_CLIENTS ,  
+//       :      .
+//  -     ,    
+static int serveSocket(const char *path, const Schedule &schedule, const CodeTable &points,
+                       const DiscountRules &rules) {
+#ifdef _WIN32
+    fprintf(stderr, "%s: unix sockets are not supported on this platform\n", path);
+    return 1;
+#else
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path is too long\n", path);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+
+    //   -  ,    
+    signal(SIGPIPE, SIG_IGN);
+
+    //   ,    ;       
+    struct stat info;
+    if (lstat(path, &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            fprintf(stderr, "%s: exists and is not a socket\n", path);
+            return 1;
+        }
+        unlink(path);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return 1;
+    }
+    if (bind(listener, (const sockaddr *) &address, sizeof(address)) || listen(listener, SOMAXCONN)) {
+        perror(path);
+        close(listener);
+        return 1;
+    }
+
+    std::atomic<bool> stopping(false);
+    auto work = [&] {
+        for (;;) {
+            int client = accept(listener, 0, 0);
+            if (client < 0) {
+                if (stopping)
+                    return;
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                    //     ,    
+                    usleep(100 * 1000);
                     continue;
                 }
-                //       
-                TransLeg *newLeg = new TransLeg;
-                newLeg->flight = *it_f->second;
-                auto&[sum, f_lag, lastlag] = it->second;
-                lastlag->next = newLeg;         // 
-                lastlag = newLeg;               // 
-                sum += newLeg->flight.fare;    //    ,    
-                it++;
-
+                perror("accept");
+                //     accept   
+                stopping = true;
+                shutdown(listener, SHUT_RDWR);
+                return;
             }
-            //  -          -
-            //      ,      
+            serveQueries(client, client, schedule, points, rules);
+            close(client);
         }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < SOCKET_CLIENTS; i++)
+        workers.emplace_back(work);
+    work();
+    for (std::thread &worker : workers)
+        worker.join();
+    close(listener);
+    return 1;
+#endif
+}
+
+//  :    fileName,    ,   threads .
+//    stdout   ,    ,    
+static int runBatch(const char *fileName, const Schedule &schedule, const CodeTable &points,
+                    const DiscountRules &rules, int threads) {
+    MappedFile file;
+    if (file.open(fileName)) {
+        fprintf(stderr, "cannot read %s\n", fileName);
+        return 1;
     }
-    //      ,      
-    //       
-    //          80%      
-    flush();
 
-    total_fare = std::numeric_limits<Fare>::max();
-    for (const auto &ct : carrier_transportation) {
-        auto&[ct_sum, f_lag, lastlag] = ct.second;
-        if ((ct.first == "MinFare") && (total_fare > ct_sum)) {
-            total_fare = ct_sum;
-            firstLeg = f_lag;
-        } else if ((ct.first != "MinFare") && (total_fare > ct_sum * 0.8) && f_lag->next) {
-            total_fare = ct_sum * CONST_DISCOUNT;
-            firstLeg = f_lag;
+    std::vector<Route> routes;
+    std::vector<const char *> errors;
+    for (const char *line = file.begin(); line < file.end();) {
+        const char *lineEnd = (const char *) memchr(line, '\n', file.end() - line);
+        if (!lineEnd)
+            lineEnd = file.end();
+        const char *word;
+        const char *p = line;
+        if (nextWord(p, lineEnd, word)) {
+            routes.emplace_back();
+            const char *error = routes.back().parse(line, lineEnd, points);
+            if (!error && routes.back().check())
+                error = "route is invalid";
+            if (error)
+                routes.back() = Route();    //    
+            errors.push_back(error);
         }
+        line = lineEnd + 1;
     }
 
+    TransportationBatch batch;
+    batch.build(routes, schedule, threads, rules);
+
+    OutputBuffer out(STDOUT_FD);
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (errors[i])
+            out.print("error: %s\n", errors[i]);
+        else if (!batch.isBuilt(i))
+            out.print("error: cannot build transportation\n");
+        else
+            batch.print(i, out);
+        out.write("\n", 1);
+    }
     return 0;
 }
 
-void Transportation::print() const {
-    int legNo = 0;
-    for (TransLeg *leg = firstLeg; leg; leg = leg->next) {
-        printf("% 2d: ", legNo++);
-        leg->flight.print();
-        printf("\n");
+//___
+
+//     
+struct RuleOptions {
+    std::vector<std::pair<double, const char *>> alliances;    // <,    >
+    std::vector<std::pair<int, double>> consecutive;           // <k, >
+
+    //     ;     owned. 0 - OK, !=0 - 
+    int make(const Schedule &schedule, std::vector<std::unique_ptr<DiscountRule>> &owned,
+             DiscountRules &rules) const;
+};
+
+int RuleOptions::make(const Schedule &schedule, std::vector<std::unique_ptr<DiscountRule>> &owned,
+                      DiscountRules &rules) const {
+    rules = defaultRules();
+    for (const auto &[factor, codes] : alliances) {
+        std::vector<int> carriers;
+        for (const char *p = codes; *p;) {
+            const char *comma = strchr(p, ',');
+            std::string code(p, comma ? comma - p : strlen(p));
+            int carrier = schedule.findCarrier(code.c_str());
+            if (carrier < 0) {
+                fprintf(stderr, "unknown carrier '%s'\n", code.c_str());
+                return 1;
+            }
+            carriers.push_back(carrier);
+            p = comma ? comma + 1 : p + code.size();
+        }
+        GroupRule *rule = new GroupRule(factor, false);
+        owned.emplace_back(rule);
+        rule->addGroup(carriers);
+        rules.push_back(rule);
     }
-    printf("Total fare: %.4f\n", total_fare); //format change
+    for (const auto &[k, factor] : consecutive) {
+        owned.emplace_back(new ConsecutiveRule(k, factor));
+        rules.push_back(owned.back().get());
+    }
+    return 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--schedule FILE] [--serve | --socket PATH | --batch FILE] [rules]\n"
+                    "  without a mode the route is read from route.txt\n"
+                    "  --serve        answer route queries from stdin, one per line\n"
+                    "  --socket PATH  answer route queries on a unix socket\n"
+                    "  --batch FILE   price all routes of FILE in parallel\n"
+                    "discount rules (the best single rule applies; one carrier for the whole route - %g):\n"
+                    "  --alliance FACTOR CODES  whole route within carriers CODES (comma-separated)\n"
+                    "  --consecutive K FACTOR   legs from the K-th in a row on one carrier\n",
+            program, CONST_DISCOUNT);
 }
 
+//     : (0, 1]
+static bool parseFactor(const char *text, double &factor) {
+    char *end;
+    factor = strtod(text, &end);
+    return *text && !*end && factor > 0 && factor <= 1;
+}
 
-//___
+int main(int argc, char *argv[]) {
+    const char *scheduleFile = "schedule.txt";
+    const char *socketPath = 0;
+    const char *batchFile = 0;
+    bool serve = false;
+    RuleOptions ruleOptions;
+    for (int i = 1; i < argc; i++) {
+        double factor;
+        if (!strcmp(argv[i], "--schedule") && i + 1 < argc)
+            scheduleFile = argv[++i];
+        else if (!strcmp(argv[i], "--socket") && i + 1 < argc)
+            socketPath = argv[++i];
+        else if (!strcmp(argv[i], "--batch") && i + 1 < argc)
+            batchFile = argv[++i];
+        else if (!strcmp(argv[i], "--serve"))
+            serve = true;
+        else if (!strcmp(argv[i], "--alliance") && i + 2 < argc && parseFactor(argv[i + 1], factor)) {
+            ruleOptions.alliances.emplace_back(factor, argv[i + 2]);
+            i += 2;
+        } else if (!strcmp(argv[i], "--consecutive") && i + 2 < argc && atoi(argv[i + 1]) > 0
+                   && parseFactor(argv[i + 2], factor)) {
+            ruleOptions.consecutive.emplace_back(atoi(argv[i + 1]), factor);
+            i += 2;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    //       
+    CodeTable points;
+    const int threads = (int) std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::unique_ptr<DiscountRule>> ownedRules;
+    DiscountRules rules;
+
+    //  :    ,  -  
+    if (serve || socketPath || batchFile) {
+        Schedule schedule(points);
+        if (schedule.read(scheduleFile, threads)) {
+            fprintf(stderr, "cannot read schedule\n");
+            return 1;
+        }
+        if (ruleOptions.make(schedule, ownedRules, rules))
+            return 1;
+        if (socketPath)
+            return serveSocket(socketPath, schedule, points, rules);
+        if (batchFile)
+            return runBatch(batchFile, schedule, points, rules, threads);
+        serveQueries(STDIN_FD, STDOUT_FD, schedule, points, rules);
+        return 0;
+    }
+
+    OutputBuffer out(STDOUT_FD);
 
-int main() {
     //  
     Route route;
-    if (route.read("route.txt")) {
+    if (route.read("route.txt", points)) {
         fprintf(stderr, "cannot read route\n");
         return 1;
     }
-    route.print("Route read: ");
+    route.print(out, "Route read: ");
     if (route.check()) {
         fprintf(stderr, "route is invalid\n");
         return 1;
     }
 
     //  
-    Schedule schedule;
-    if (schedule.read("schedule.txt")) {
+    Schedule schedule(points);
+    if (schedule.read(scheduleFile, threads)) {
         fprintf(stderr, "cannot read schedule\n");
         return 1;
     }
-    printf("\nSchedule read:\n");
-    schedule.print();
+    if (ruleOptions.make(schedule, ownedRules, rules))
+        return 1;
+    out.print("\nSchedule read:\n");
+    schedule.print(out);
 
     //  
-    Transportation trans;
+    Transportation trans(rules);
     if (trans.buildCheapest(route, schedule)) {
         fprintf(stderr, "cannot build transportation\n");
         return 1;
     }
 
-    printf("\nCheapest transportation:\n");
-    trans.print();
+    out.print("\nCheapest transportation:\n");
+    trans.print(out);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,136 @@
+#include "batch.h"
+#include "event_parser.h"
+#include "flat_document.h"
+#include "mapped_file.h"
+#include "output_buffer.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <system_error>
+
+namespace parser {
+
+    namespace fs = std::filesystem;
+
+    std::vector<BatchJob> ListBatchJobs(const std::string &source, const std::string &output_dir) {
+        std::vector<BatchJob> jobs;
+        const auto add = [&jobs, &output_dir](const fs::path &input, const fs::path &output_name) {
+            jobs.push_back({input.string(), (fs::path(output_dir) / output_name).string()});
+        };
+
+        if (fs::is_directory(source)) {
+            for (const auto &entry: fs::directory_iterator(source)) {
+                if (entry.is_regular_file()) {
+                    add(entry.path(), entry.path().filename());
+                }
+            }
+            std::sort(jobs.begin(), jobs.end(), [](const BatchJob &lhs, const BatchJob &rhs) {
+                return lhs.input < rhs.input;
+            });
+            return jobs;
+        }
+
+        std::ifstream manifest(source);
+        if (!manifest) {
+            throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), source);
+        }
+        for (std::string line; std::getline(manifest, line);) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            const size_t tab = line.find('\t');
+            const fs::path input = line.substr(0, tab);
+            add(input, tab == std::string::npos ? input.filename() : fs::path(line.substr(tab + 1)));
+        }
+        return jobs;
+    }
+
+    namespace {
+
+        // Запись готового вывода. Обычный файл пишется во временный рядом с ним и переименовывается
+        // после успешной записи, поэтому при ошибке не остается обрезанного файла, а прежний не портится.
+        // Устройства и каналы (например, /dev/null) пишутся напрямую. Ошибка видна только после close:
+        // небольшой вывод уходит в файл при сбросе буфера потока
+        bool WriteOutput(const std::string &path, std::string_view data) {
+            std::error_code error;
+            const fs::file_status status = fs::status(path, error);
+            if (fs::exists(status) && !fs::is_regular_file(status)) {
+                std::ofstream file(path, std::ios::binary);
+                file.write(data.data(), static_cast<std::streamsize>(data.size()));
+                file.close();
+                return !file.fail();
+            }
+
+            const std::string temp = path + ".part";
+            std::ofstream file(temp, std::ios::binary);
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            file.close();
+            if (!file.fail()) {
+                fs::rename(temp, path, error);
+                if (!error) {
+                    return true;
+                }
+            }
+            fs::remove(temp, error);
+            return false;
+        }
+
+        // Конвертация одного файла в буфер: снимок выводится без разбора, текст - потоковым разбором
+        void ConvertFile(const std::string &path, OutputBuffer &out) {
+            const MappedFile file(path);
+            if (IsSnapshot(file.Data())) {
+                Print(ReadSnapshot(file.Data()), out);
+            } else {
+                ConvertStreaming(file.Data(), out);
+            }
+        }
+
+    } // namespace
+
+    BatchReport ConvertBatch(const std::vector<BatchJob> &jobs, size_t threads) {
+        using namespace std::literals;
+
+        const size_t workers = std::min(threads ? threads : DefaultThreadCount(), jobs.size());
+        std::vector<std::string> errors(jobs.size());
+        std::vector<ParseStats> stats(jobs.size());
+        std::atomic<size_t> next{0};
+
+        // задача пула - рабочий поток целиком: он разбирает задания по очереди и переиспользует свой буфер
+        ParallelFor(workers, workers, [&](size_t) {
+            OutputBuffer out;
+            for (size_t i = next++; i < jobs.size(); i = next++) {
+                out.Clear();
+                const StatsScope scope;
+                try {
+                    ConvertFile(jobs[i].input, out);
+                    if (!WriteOutput(jobs[i].output, out.Data())) {
+                        errors[i] = "cannot write "s + jobs[i].output;
+                    }
+                } catch (const std::exception &e) {
+                    errors[i] = *e.what() ? e.what() : "conversion failed"s;
+                }
+                stats[i] = scope.Get();
+            }
+        });
+
+        BatchReport report;
+        report.stats = std::move(stats);
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            if (errors[i].empty()) {
+                ++report.converted;
+            } else {
+                report.failures.push_back({jobs[i].input, std::move(errors[i])});
+            }
+        }
+        return report;
+    }
+
+} //namespace parser
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "stats.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace parser {
+
+    struct BatchJob {
+        std::string input;
+        std::string output;
+    };
+
+    struct BatchFailure {
+        std::string input;
+        std::string error;
+    };
+
+    struct BatchReport {
+        size_t converted = 0;
+        std::vector<BatchFailure> failures;     // в порядке заданий
+        std::vector<ParseStats> stats;          // статистика каждого задания (нули без PARSER_STATS)
+    };
+
+    // Задания пакетной конвертации. source - каталог (все обычные файлы в нем, без подкаталогов,
+    // по алфавиту) или файл-манифест: по пути входного файла в строке, пустые строки пропускаются.
+    // В строке манифеста после табуляции можно задать имя выходного файла, иначе берется имя входного.
+    // Выходные файлы лежат в output_dir. Бросает std::system_error, если source не читается
+    std::vector<BatchJob> ListBatchJobs(const std::string &source, const std::string &output_dir);
+
+    // Конвертирует файлы на пуле из threads потоков (0 - по числу аппаратных потоков).
+    // У каждого потока свой буфер вывода на все его файлы, файлы разбираются потоково, без построения дерева.
+    // Выходной файл пишется только после успешной конвертации, через временный файл и переименование:
+    // при ошибке записи выходной файл не создается и прежний не меняется. Ошибка одного файла
+    // (не открылся, неверный формат, не записался) попадает в отчет и не останавливает остальные
+    BatchReport ConvertBatch(const std::vector<BatchJob> &jobs, size_t threads = 0);
+
+} //namespace parser
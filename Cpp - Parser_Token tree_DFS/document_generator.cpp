@@ -0,0 +1,68 @@
+#include "document_generator.h"
+
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace parser {
+
+    GeneratedDocument GenerateDocument(const GeneratorOptions &options) {
+        using namespace std::literals;
+
+        if (options.width < 1 || options.depth < 1 || options.distinct_names == 0) {
+            throw std::invalid_argument("GenerateDocument()"s);
+        }
+
+        std::mt19937 random(options.seed);
+        std::uniform_int_distribution<size_t> name_dist(0, options.distinct_names - 1);
+        std::uniform_int_distribution<size_t> length_dist(0, 2 * options.string_length);
+        std::bernoulli_distribution null_dist(options.null_share);
+        std::bernoulli_distribution escape_dist(options.escape_density);
+
+        constexpr std::string_view kPlain = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _.,-"sv;
+        constexpr std::string_view kEscapes[] = {"\\\""sv, "\\\\"sv, "\\n"sv, "\\t"sv, "\\r"sv};
+        std::uniform_int_distribution<size_t> plain_dist(0, kPlain.size() - 1);
+        std::uniform_int_distribution<size_t> escape_kind_dist(0, std::size(kEscapes) - 1);
+
+        GeneratedDocument result;
+        std::string &text = result.text;
+        text = "root = {"s;
+        result.nodes = 1;
+
+        // число еще не выведенных потомков открытых списков, обход без рекурсии
+        std::vector<int> open{options.width};
+        while (!open.empty()) {
+            if (open.back() == 0) {
+                text += " }"sv;
+                open.pop_back();
+                continue;
+            }
+            --open.back();
+            ++result.nodes;
+
+            text += '\n';
+            text += "node"sv;
+            text += std::to_string(name_dist(random));
+            text += " = "sv;
+            if (static_cast<int>(open.size()) < options.depth) {
+                text += '{';
+                open.push_back(options.width);
+            } else if (null_dist(random)) {
+                text += "null"sv;
+            } else {
+                text += '"';
+                for (size_t i = length_dist(random); i > 0; --i) {
+                    if (escape_dist(random)) {
+                        text += kEscapes[escape_kind_dist(random)];
+                    } else {
+                        text += kPlain[plain_dist(random)];
+                    }
+                }
+                text += '"';
+            }
+        }
+        return result;
+    }
+
+} //namespace parser
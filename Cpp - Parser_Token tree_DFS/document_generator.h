@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace parser {
+
+    // Параметры синтетического документа. Корень и все списки до глубины depth имеют по width
+    // потомков, на глубине depth лежат листья: строки или null
+    struct GeneratorOptions {
+        uint32_t seed = 1;
+        int width = 8;
+        int depth = 4;
+        size_t string_length = 16;      // средняя длина значения (длины равномерны в [0, 2 * string_length])
+        double escape_density = 0.0;    // доля символов значения, записанных escape-последовательностью
+        size_t distinct_names = 16;     // размер набора имен: чем меньше, тем чаще имена повторяются
+        double null_share = 0.1;        // доля листьев со значением null
+    };
+
+    struct GeneratedDocument {
+        std::string text;
+        size_t nodes = 0;
+    };
+
+    // Документ во входном формате. Одинаковые параметры (вместе с seed) дают одинаковый текст.
+    // Бросает std::invalid_argument при width < 1, depth < 1 или пустом наборе имен
+    GeneratedDocument GenerateDocument(const GeneratorOptions &options);
+
+} //namespace parser
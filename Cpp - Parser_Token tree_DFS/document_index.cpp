@@ -0,0 +1,163 @@
+#include "document_index.h"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+
+namespace parser {
+
+    std::vector<PathSegment> SplitPath(std::string_view path) {
+        using namespace std::literals;
+
+        const auto fail = [path] {
+            throw std::invalid_argument("Неверный путь: "s + std::string(path));
+        };
+
+        std::vector<PathSegment> segments;
+        size_t begin = 0;
+        while (true) {
+            const size_t slash = path.find('/', begin);
+            std::string_view segment = path.substr(begin, slash == std::string_view::npos ? slash : slash - begin);
+
+            PathSegment result;
+            if (!segment.empty() && segment.back() == ']') {
+                const size_t bracket = segment.find('[');
+                if (bracket == std::string_view::npos) {
+                    fail();
+                }
+                const std::string_view digits = segment.substr(bracket + 1, segment.size() - bracket - 2);
+                const auto parsed = std::from_chars(digits.data(), digits.data() + digits.size(), result.index);
+                if (digits.empty() || parsed.ec != std::errc() || parsed.ptr != digits.data() + digits.size()) {
+                    fail();
+                }
+                segment = segment.substr(0, bracket);
+            }
+            if (segment.empty()) {
+                fail();
+            }
+            result.name = segment;
+            segments.push_back(result);
+
+            if (slash == std::string_view::npos) {
+                return segments;
+            }
+            begin = slash + 1;
+        }
+    }
+
+    DocumentIndex::DocumentIndex(const Document &doc)
+            : doc_(doc) {
+    }
+
+    void DocumentIndex::BuildIds() const {
+        // обход в глубину по явному стеку: узел и id его родителя
+        std::vector<Entry> order;
+        std::vector<Entry> stack{{&doc_.GetRoot(), 0}};
+        int max_id = 0;
+        bool non_negative = true;
+        while (!stack.empty()) {
+            const Entry entry = stack.back();
+            stack.pop_back();
+            order.push_back(entry);
+            max_id = std::max(max_id, entry.node->GetId());
+            non_negative = non_negative && entry.node->GetId() >= 0;
+            if (entry.node->IsArray()) {
+                const Array &list = entry.node->AsArray();
+                for (auto it = list.rbegin(); it != list.rend(); ++it) {
+                    stack.push_back({&*it, entry.node->GetId()});
+                }
+            }
+        }
+
+        if (non_negative && static_cast<size_t>(max_id) <= 2 * order.size() + 16) {
+            dense_.resize(static_cast<size_t>(max_id) + 1);
+            for (const Entry &entry: order) {
+                Entry &slot = dense_[entry.node->GetId()];
+                if (!slot.node) {
+                    slot = entry;
+                }
+            }
+        } else {
+            sparse_.reserve(order.size());
+            for (const Entry &entry: order) {
+                sparse_.emplace(entry.node->GetId(), entry);
+            }
+        }
+    }
+
+    const DocumentIndex::Entry *DocumentIndex::FindEntry(int id) const {
+        std::call_once(ids_built_, [this] { BuildIds(); });
+        if (!dense_.empty()) {
+            if (id < 0 || static_cast<size_t>(id) >= dense_.size() || !dense_[id].node) {
+                return nullptr;
+            }
+            return &dense_[id];
+        }
+        const auto it = sparse_.find(id);
+        return it == sparse_.end() ? nullptr : &it->second;
+    }
+
+    const Node *DocumentIndex::FindById(int id) const {
+        const Entry *entry = FindEntry(id);
+        return entry ? entry->node : nullptr;
+    }
+
+    int DocumentIndex::GetParentId(int id) const {
+        const Entry *entry = FindEntry(id);
+        return entry ? entry->parent_id : -1;
+    }
+
+    const Array &DocumentIndex::GetChildren(int parent_id) const {
+        static const Array empty;
+        const Node *node = FindById(parent_id);
+        return node && node->IsArray() ? node->AsArray() : empty;
+    }
+
+    const Node *DocumentIndex::FindChild(const Array &list, std::string_view name, size_t k) const {
+        if (list.size() < kMinHashedChildren) {
+            for (const Node &child: list) {
+                if (child.GetName() == name && k-- == 0) {
+                    return &child;
+                }
+            }
+            return nullptr;
+        }
+
+        const NameMap *names = nullptr;
+        {
+            std::shared_lock lock(names_mutex_);
+            const auto it = names_.find(&list);
+            if (it != names_.end()) {
+                names = it->second.get();
+            }
+        }
+        if (!names) {
+            // таблица строится без блокировки; если другой поток успел первым, берется его таблица
+            auto built = std::make_unique<NameMap>();
+            for (const Node &child: list) {
+                (*built)[child.GetName()].push_back(&child);
+            }
+            std::unique_lock lock(names_mutex_);
+            auto &slot = names_[&list];
+            if (!slot) {
+                slot = std::move(built);
+            }
+            names = slot.get();
+        }
+        const auto it = names->find(name);
+        return it != names->end() && k < it->second.size() ? it->second[k] : nullptr;
+    }
+
+    const Node *DocumentIndex::FindByPath(std::string_view path) const {
+        const std::vector<PathSegment> segments = SplitPath(path);
+        // первый сегмент - корень
+        const Node &root = doc_.GetRoot();
+        const Node *node = root.GetName() == segments[0].name && segments[0].index == 0 ? &root : nullptr;
+        for (size_t i = 1; node && i < segments.size(); ++i) {
+            node = node->IsArray() ? FindChild(node->AsArray(), segments[i].name, segments[i].index) : nullptr;
+        }
+        return node;
+    }
+
+} //namespace parser
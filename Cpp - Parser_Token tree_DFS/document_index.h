@@ -0,0 +1,79 @@
+#pragma once
+
+#include "parser.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace parser {
+
+    // Сегмент пути "name" или "name[index]"
+    struct PathSegment {
+        std::string_view name;
+        size_t index = 0;
+    };
+
+    // Разбирает путь вида "shape/vertices/point[2]/x" на сегменты. Индекс в скобках - номер (с нуля)
+    // среди соседей с тем же именем, без скобок - 0. Синтаксически неверный путь - std::invalid_argument
+    std::vector<PathSegment> SplitPath(std::string_view path);
+
+    // Индекс для поиска узлов документа без обхода дерева:
+    //   id -> узел и id родителя за O(1);
+    //   id списка -> его потомки;
+    //   путь вида "shape/vertices/point[2]/x" - по хеш-таблицам имен на каждом уровне.
+    // Части индекса строятся при первом обращении к ним. Документ должен жить дольше индекса
+    // и не меняться. Константные методы можно вызывать из нескольких потоков
+    class DocumentIndex {
+    public:
+        // списки с меньшим числом потомков просматриваются при поиске по пути подряд, без хеш-таблицы
+        static constexpr size_t kMinHashedChildren = 16;
+
+        explicit DocumentIndex(const Document &doc);
+
+        // nullptr, если узла с таким id нет. При повторяющихся id - первый узел в порядке обхода
+        const Node *FindById(int id) const;
+
+        // id родителя (0 для корня), -1 - узла с таким id нет
+        int GetParentId(int id) const;
+
+        // непосредственные потомки; пустой список для листьев и неизвестных id
+        const Array &GetChildren(int parent_id) const;
+
+        // Путь - имена узлов от корня через '/' (см. SplitPath). nullptr, если узла нет
+        const Node *FindByPath(std::string_view path) const;
+
+    private:
+        struct Entry {
+            const Node *node = nullptr;
+            int parent_id = -1;
+        };
+
+        // имя -> потомки с этим именем в порядке следования
+        using NameMap = std::unordered_map<std::string_view, std::vector<const Node *>>;
+
+        void BuildIds() const;
+
+        const Entry *FindEntry(int id) const;
+
+        // k-й потомок списка с именем name
+        const Node *FindChild(const Array &list, std::string_view name, size_t k) const;
+
+        const Document &doc_;
+
+        mutable std::once_flag ids_built_;
+        // id плотные (как после разбора) - прямая таблица, иначе хеш-таблица
+        mutable std::vector<Entry> dense_;
+        mutable std::unordered_map<int, Entry> sparse_;
+
+        // таблицы имен уже просмотренных списков ищутся под разделяемой блокировкой,
+        // исключительная нужна только для добавления новой
+        mutable std::shared_mutex names_mutex_;
+        mutable std::unordered_map<const Array *, std::unique_ptr<NameMap>> names_;
+    };
+
+} //namespace parser
@@ -0,0 +1,164 @@
+#include "event_parser.h"
+#include "parser.h"
+#include "stats.h"
+#include "structural_index.h"
+
+#include <vector>
+
+namespace parser {
+
+    const ListSpans::Span &ListSpans::Get(size_t ordinal) {
+        if (!built_) {
+            Build();
+        }
+        return spans_.at(ordinal);
+    }
+
+    void ListSpans::Build() {
+        built_ = true;
+        // скобки из структурного индекса - вне строк, в том же порядке, что и лексемы списков
+        StructuralScanner scanner(input_);
+        std::vector<uint64_t> structurals, specials;
+        std::vector<size_t> open;
+        while (scanner.ScanChunk(structurals, specials)) {
+            for (uint64_t pos: structurals) {
+                const char c = input_[pos];
+                if (c == '{') {
+                    open.push_back(spans_.size());
+                    spans_.push_back({std::string_view::npos, 0});
+                } else if (c == '}' && !open.empty()) {
+                    Span &span = spans_[open.back()];
+                    open.pop_back();
+                    span.close = pos;
+                    span.next = spans_.size();
+                }
+            }
+            structurals.clear();
+            specials.clear();
+        }
+        for (size_t ordinal: open) {
+            spans_[ordinal].next = spans_.size();
+        }
+    }
+
+    // Общий цикл разбора. В режиме sequence узлы верхнего уровня идут подряд до конца буфера
+    void ParseNodes(std::string_view input, ParseHandler &handler, IdAllocator &ids, bool sequence, int top_parent) {
+        using namespace std::literals;
+        PARSER_STATS_PHASE(Build);
+
+        std::vector<int> open;  // id открытых списков
+        ListSpans spans(input);
+        size_t list_ordinal = 0;
+        // первый проход (структурный индекс) идет порциями впереди второго
+        IndexedLexer lexer(input);
+
+        Token token = lexer.Next();
+        do {
+            if ((sequence || !open.empty()) && token.type == TokenType::Separator) {
+                token = lexer.Next();
+            }
+            if (token.type != TokenType::Name) {
+                ThrowFormatError();
+            }
+            const std::string_view name = token.text;
+            if (lexer.Next().type != TokenType::Assign) {
+                ThrowFormatError();
+            }
+
+            const int id = ids.GetNextID();
+            handler.OnNodeBegin(id, open.empty() ? top_parent : open.back(), name);
+            PARSER_STATS_ADD(nodes, 1);
+
+            const Token value = lexer.Next();
+            if (value.type == TokenType::ListBegin) {
+                handler.OnListBegin(id, ListPreview(input, lexer.Position(), spans, list_ordinal++));
+                open.push_back(id);
+                PARSER_STATS_MAX(max_depth, open.size());
+                // пустой список не допускается - следующим должен идти узел
+                token = lexer.Next();
+                continue;
+            } else if (value.type == TokenType::String) {
+                handler.OnValue(id, value.text);
+                PARSER_STATS_ADD(strings, 1);
+            } else if (value.type == TokenType::Name && value.text == "null"sv) {
+                handler.OnNull(id);
+            } else {
+                ThrowFormatError();
+            }
+
+            // закрываем завершенные списки
+            token = lexer.Next();
+            while (!open.empty() && token.type == TokenType::ListEnd) {
+                handler.OnListEnd(open.back());
+                open.pop_back();
+                if (!open.empty() || sequence) {
+                    token = lexer.Next();
+                }
+            }
+        } while (!open.empty() || (sequence && token.type != TokenType::End));
+    }
+
+    void Parse(std::string_view input, ParseHandler &handler) {
+        IdAllocator ids;
+        Parse(input, handler, ids);
+    }
+
+    void Parse(std::string_view input, ParseHandler &handler, IdAllocator &ids) {
+        ParseNodes(input, handler, ids, false, 0);
+    }
+
+    void ParseSequence(std::string_view input, ParseHandler &handler, IdAllocator &ids, int parent_id) {
+        ParseNodes(input, handler, ids, true, parent_id);
+    }
+
+    StreamingEmitter::StreamingEmitter(std::ostream &out)
+            : own_(out), out_(own_) {
+    }
+
+    StreamingEmitter::StreamingEmitter(OutputBuffer &out)
+            : out_(out) {
+    }
+
+    void StreamingEmitter::OnNodeBegin(int id, int parent_id, std::string_view name) {
+        WriteNodePrefix(out_, 2 * depth_, id, parent_id, name);
+    }
+
+    void StreamingEmitter::OnValue([[maybe_unused]] int id, std::string_view value) {
+        out_.WriteEscaped(value);
+        out_.Put('\n');
+    }
+
+    void StreamingEmitter::OnNull([[maybe_unused]] int id) {
+        out_.Write("null\n");
+    }
+
+    void StreamingEmitter::OnListBegin([[maybe_unused]] int id, const ListPreview &children) {
+        bool first = true;
+        out_.Put('{');
+        children.ForEachChildName([this, &first](std::string_view name) {
+            if (!first) {
+                out_.Put(' ');
+            }
+            first = false;
+            out_.Write(name);
+        });
+        out_.Put('}');
+        out_.Put('\n');
+        ++depth_;
+    }
+
+    void StreamingEmitter::OnListEnd([[maybe_unused]] int id) {
+        --depth_;
+    }
+
+    void ConvertStreaming(std::string_view input, std::ostream &out) {
+        StreamingEmitter emitter(out);
+        Parse(input, emitter);
+    }
+
+    void ConvertStreaming(std::string_view input, OutputBuffer &out) {
+        StreamingEmitter emitter(out);
+        Parse(input, emitter);
+    }
+
+} //namespace parser
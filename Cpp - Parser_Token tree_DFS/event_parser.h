@@ -0,0 +1,145 @@
+#pragma once
+
+#include "lexer.h"
+#include "parser.h"
+
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace parser {
+
+    // Границы всех списков входа в порядке открывающих скобок. Таблица строится одним проходом
+    // структурного индекса при первом обращении (16 байт на список), поэтому предпросмотр перескакивает
+    // вложенные списки, не просматривая их тела. Пока не вызван Get, ничего не стоит
+    class ListSpans {
+    public:
+        struct Span {
+            size_t close;   // позиция закрывающей скобки, npos - список не закрыт
+            size_t next;    // номер первого списка после поддерева
+        };
+
+        explicit ListSpans(std::string_view input)
+                : input_(input) {
+        }
+
+        // список с номером ordinal (с нуля, по порядку открывающих скобок)
+        const Span &Get(size_t ordinal);
+
+    private:
+        void Build();
+
+        std::string_view input_;
+        bool built_ = false;
+        std::vector<Span> spans_;
+    };
+
+    // Предпросмотр непосредственных потомков только что открытого списка.
+    // Ничего не стоит, пока не вызван ForEachChildName: тогда просматриваются только лексемы
+    // самого списка, вложенные списки перескакиваются по таблице ListSpans. Время всех предпросмотров
+    // одного разбора линейно по размеру входа при любой глубине вложенности.
+    // Предпросмотр действителен только во время вызова OnListBegin
+    class ListPreview {
+    public:
+        // body_begin - смещение сразу после открывающей скобки списка, ordinal - номер списка в spans
+        ListPreview(std::string_view input, size_t body_begin, ListSpans &spans, size_t ordinal)
+                : input_(input), body_begin_(body_begin), spans_(&spans), ordinal_(ordinal) {
+        }
+
+        template<typename Callback>
+        void ForEachChildName(Callback &&callback) const {
+            Lexer lexer(input_, body_begin_);
+            size_t nested = ordinal_ + 1;   // номер следующего вложенного списка
+            Token prev;
+            for (Token token = lexer.Next(); token.type != TokenType::End && token.type != TokenType::Invalid;
+                 token = lexer.Next()) {
+                if (token.type == TokenType::ListBegin) {
+                    const ListSpans::Span &span = spans_->Get(nested);
+                    if (span.close == std::string_view::npos) {
+                        // незакрытый вложенный список тянется до конца входа
+                        return;
+                    }
+                    lexer = Lexer(input_, span.close + 1);
+                    nested = span.next;
+                } else if (token.type == TokenType::ListEnd) {
+                    return;
+                } else if (token.type == TokenType::Assign && prev.type == TokenType::Name) {
+                    callback(prev.text);
+                }
+                prev = token;
+            }
+        }
+
+    private:
+        std::string_view input_;
+        size_t body_begin_;
+        ListSpans *spans_;
+        size_t ordinal_;
+    };
+
+    // Обработчик событий потокового разбора. События приходят в порядке обхода в глубину:
+    // OnNodeBegin, затем одно из OnValue / OnNull / OnListBegin, для списков - потомки и OnListEnd.
+    // Значение действительно только на время вызова, имя узла - до следующего события
+    class ParseHandler {
+    public:
+        virtual ~ParseHandler() = default;
+
+        // начало узла, parent_id корня равен 0
+        virtual void OnNodeBegin(int id, int parent_id, std::string_view name) = 0;
+
+        // строковое значение узла, escape-последовательности уже раскодированы
+        virtual void OnValue(int id, std::string_view value) = 0;
+
+        virtual void OnNull(int id) = 0;
+
+        virtual void OnListBegin(int id, const ListPreview &children) = 0;
+
+        virtual void OnListEnd(int id) = 0;
+    };
+
+    // Разбор буфера с вызовом обработчика по мере чтения узлов. Дерево не строится,
+    // память парсера пропорциональна глубине вложенности. Ошибка формата - ParsingError,
+    // события, пришедшие до ошибки, обработчиком уже получены
+    void Parse(std::string_view input, ParseHandler &handler);
+
+    // Разбор с внешним счетчиком id (например, чтобы продолжить нумерацию другого разбора)
+    void Parse(std::string_view input, ParseHandler &handler, IdAllocator &ids);
+
+    // Разбор последовательности соседних узлов без обрамляющего списка, как в теле списка:
+    // "a = ... b = ..." до конца буфера. Узлы верхнего уровня получают родителя parent_id
+    void ParseSequence(std::string_view input, ParseHandler &handler, IdAllocator &ids, int parent_id);
+
+    // Обработчик, который сразу пишет строки выходного формата Print.
+    // Строка списка выводится при его открытии: имена потомков берутся из ListPreview,
+    // поэтому дерево не строится. Плата за это - таблица границ списков ListSpans (16 байт на список)
+    class StreamingEmitter : public ParseHandler {
+    public:
+        explicit StreamingEmitter(std::ostream &out);
+
+        // строки пишутся в чужой буфер, например переиспользуемый между конвертациями
+        explicit StreamingEmitter(OutputBuffer &out);
+
+        void OnNodeBegin(int id, int parent_id, std::string_view name) override;
+
+        void OnValue(int id, std::string_view value) override;
+
+        void OnNull(int id) override;
+
+        void OnListBegin(int id, const ListPreview &children) override;
+
+        void OnListEnd(int id) override;
+
+    private:
+        // при выводе в поток строки копятся в собственном буфере и уходят в поток крупными блоками
+        // (и при разрушении обработчика)
+        OutputBuffer own_;
+        OutputBuffer &out_;
+        int depth_ = 0;
+    };
+
+    // Потоковая конвертация: вывод совпадает с Print(Load(input), out)
+    void ConvertStreaming(std::string_view input, std::ostream &out);
+
+    void ConvertStreaming(std::string_view input, OutputBuffer &out);
+
+} //namespace parser
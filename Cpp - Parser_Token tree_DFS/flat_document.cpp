@@ -0,0 +1,309 @@
+#include "flat_document.h"
+#include "event_parser.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+namespace parser {
+
+    FlatView::FlatView(const FlatNode *nodes, size_t size, const PoolString *symbols, size_t symbol_count,
+                       std::string_view pool)
+            : nodes_(nodes), size_(size), symbols_(symbols), symbol_count_(symbol_count), pool_(pool) {
+    }
+
+    size_t FlatView::Size() const {
+        return size_;
+    }
+
+    const FlatNode &FlatView::GetNode(uint32_t id) const {
+        using namespace std::literals;
+
+        if (id == 0 || id > size_) {
+            throw std::out_of_range("FlatView::GetNode()"s);
+        }
+        return nodes_[id - 1];
+    }
+
+    std::string_view FlatView::GetName(uint32_t id) const {
+        return GetSymbol(GetNode(id).name);
+    }
+
+    std::string_view FlatView::GetValue(uint32_t id) const {
+        return GetString(GetNode(id).value);
+    }
+
+    std::string_view FlatView::GetSymbol(uint32_t symbol) const {
+        using namespace std::literals;
+
+        if (symbol >= symbol_count_) {
+            throw std::out_of_range("FlatView::GetSymbol()"s);
+        }
+        return GetString(symbols_[symbol]);
+    }
+
+    size_t FlatView::SymbolCount() const {
+        return symbol_count_;
+    }
+
+    const PoolString *FlatView::GetSymbols() const {
+        return symbols_;
+    }
+
+    std::string_view FlatView::GetPool() const {
+        return pool_;
+    }
+
+    std::string_view FlatView::GetString(PoolString str) const {
+        return pool_.substr(str.offset, str.size);
+    }
+
+    size_t FlatDocument::Size() const {
+        return nodes_.size();
+    }
+
+    const FlatNode &FlatDocument::GetNode(uint32_t id) const {
+        return nodes_.at(id - 1);
+    }
+
+    std::string_view FlatDocument::GetName(uint32_t id) const {
+        return View().GetName(id);
+    }
+
+    std::string_view FlatDocument::GetValue(uint32_t id) const {
+        return View().GetValue(id);
+    }
+
+    const std::vector<FlatNode> &FlatDocument::GetNodes() const {
+        return nodes_;
+    }
+
+    uint32_t FlatDocument::AddNode(uint32_t parent_id, uint32_t prev_sibling, std::string_view name,
+                                   NodeKind kind, std::string_view value) {
+        FlatNode node;
+        node.parent_id = parent_id;
+        node.kind = kind;
+        node.name = names_.Intern(name);
+        if (node.name == symbols_.size()) {
+            // новое имя
+            symbols_.push_back(AddString(name));
+        }
+        if (kind == NodeKind::String) {
+            node.value = AddString(value);
+        }
+        nodes_.push_back(node);
+
+        const auto id = static_cast<uint32_t>(nodes_.size());
+        nodes_.back().last_descendant = id;
+        if (prev_sibling) {
+            nodes_[prev_sibling - 1].next_sibling = id;
+        } else if (parent_id) {
+            nodes_[parent_id - 1].first_child = id;
+        }
+        return id;
+    }
+
+    FlatView FlatDocument::View() const {
+        return {nodes_.data(), nodes_.size(), symbols_.data(), symbols_.size(), pool_};
+    }
+
+    void FlatDocument::CloseList(uint32_t id) {
+        nodes_.at(id - 1).last_descendant = static_cast<uint32_t>(nodes_.size());
+    }
+
+    PoolString FlatDocument::AddString(std::string_view text) {
+        PoolString result{pool_.size(), static_cast<uint32_t>(text.size())};
+        pool_.append(text);
+        return result;
+    }
+
+    // Обработчик событий разбора, заполняющий таблицу узлов
+    class FlatBuilder : public ParseHandler {
+    public:
+        explicit FlatBuilder(FlatDocument &doc)
+                : doc_(doc) {
+        }
+
+        void OnNodeBegin([[maybe_unused]] int id, [[maybe_unused]] int parent_id, std::string_view name) override {
+            name_ = name;
+        }
+
+        void OnValue([[maybe_unused]] int id, std::string_view value) override {
+            Add(NodeKind::String, value);
+        }
+
+        void OnNull([[maybe_unused]] int id) override {
+            Add(NodeKind::Null, {});
+        }
+
+        void OnListBegin([[maybe_unused]] int id, [[maybe_unused]] const ListPreview &children) override {
+            open_.push_back({Add(NodeKind::List, {}), 0});
+        }
+
+        void OnListEnd([[maybe_unused]] int id) override {
+            doc_.CloseList(open_.back().id);
+            open_.pop_back();
+        }
+
+    private:
+        uint32_t Add(NodeKind kind, std::string_view value) {
+            const uint32_t parent_id = open_.empty() ? 0 : open_.back().id;
+            const uint32_t prev_sibling = open_.empty() ? 0 : open_.back().last_child;
+            const uint32_t id = doc_.AddNode(parent_id, prev_sibling, name_, kind, value);
+            if (!open_.empty()) {
+                open_.back().last_child = id;
+            }
+            return id;
+        }
+
+        // открытые списки: id списка и id последнего добавленного потомка
+        struct OpenList {
+            uint32_t id;
+            uint32_t last_child;
+        };
+
+        FlatDocument &doc_;
+        std::vector<OpenList> open_;
+        std::string_view name_;
+    };
+
+    FlatDocument LoadFlat(std::string_view input) {
+        FlatDocument doc;
+        FlatBuilder builder(doc);
+        Parse(input, builder);
+        return doc;
+    }
+
+    FlatDocument Flatten(const Document &doc) {
+        // позиция обхода в списке дерева и соответствующий ему узел таблицы
+        struct Frame {
+            const Array *list;
+            size_t next;
+            uint32_t id;
+            uint32_t last_child;
+        };
+
+        FlatDocument result;
+        std::vector<Frame> stack;
+
+        auto add = [&result, &stack](const Node &node) {
+            const uint32_t parent_id = stack.empty() ? 0 : stack.back().id;
+            const uint32_t prev_sibling = stack.empty() ? 0 : stack.back().last_child;
+            uint32_t id;
+            if (node.IsArray()) {
+                id = result.AddNode(parent_id, prev_sibling, node.GetName(), NodeKind::List);
+            } else if (node.IsString()) {
+                id = result.AddNode(parent_id, prev_sibling, node.GetName(), NodeKind::String, node.AsString());
+            } else {
+                id = result.AddNode(parent_id, prev_sibling, node.GetName(), NodeKind::Null);
+            }
+            if (!stack.empty()) {
+                stack.back().last_child = id;
+            }
+            if (node.IsArray()) {
+                stack.push_back({&node.AsArray(), 0, id, 0});
+            }
+        };
+
+        add(doc.GetRoot());
+        while (!stack.empty()) {
+            Frame &frame = stack.back();
+            if (frame.next == frame.list->size()) {
+                result.CloseList(frame.id);
+                stack.pop_back();
+                continue;
+            }
+            add((*frame.list)[frame.next++]);
+        }
+        return result;
+    }
+
+    void Print(const FlatDocument &doc, std::ostream &out) {
+        OutputBuffer buffer(out);
+        Print(doc, buffer);
+    }
+
+    void Print(const FlatDocument &doc, OutputBuffer &out) {
+        Print(doc.View(), out);
+    }
+
+    // Вывод узлов [first, last]. open - стек открытых списков перед first, его глубина определяет отступ
+    void PrintRange(const FlatView &doc, uint32_t first, uint32_t last, std::vector<uint32_t> &open,
+                    OutputBuffer &out) {
+        for (uint32_t id = first; id <= last; ++id) {
+            const FlatNode &node = doc.GetNode(id);
+            while (open.back() != node.parent_id) {
+                if (open.size() == 1) {
+                    // родитель не предшествует узлу - таблица повреждена
+                    ThrowFormatError();
+                }
+                open.pop_back();
+            }
+            WriteNodePrefix(out, 2 * static_cast<int>(open.size() - 1), id, node.parent_id, doc.GetName(id));
+
+            if (node.kind == NodeKind::List) {
+                out.Put('{');
+                for (uint32_t child = node.first_child; child; child = doc.GetNode(child).next_sibling) {
+                    if (child != node.first_child) {
+                        out.Put(' ');
+                    }
+                    out.Write(doc.GetName(child));
+                }
+                out.Put('}');
+                out.Put('\n');
+                open.push_back(id);
+            } else if (node.kind == NodeKind::String) {
+                out.WriteEscaped(doc.GetValue(id));
+                out.Put('\n');
+            } else {
+                out.Write("null\n");
+            }
+        }
+    }
+
+    void Print(const FlatView &doc, OutputBuffer &out) {
+        PARSER_STATS_PHASE(Emit);
+        std::vector<uint32_t> open{0};
+        PrintRange(doc, 1, static_cast<uint32_t>(doc.Size()), open, out);
+    }
+
+    void PrintParallel(const FlatView &doc, std::ostream &out, const ParallelOptions &options) {
+        PARSER_STATS_PHASE(Emit);
+        const size_t threads = options.threads ? options.threads : DefaultThreadCount();
+        const uint32_t size = static_cast<uint32_t>(doc.Size());
+        if (threads < 2 || size < 2 * options.min_chunk_nodes || doc.GetNode(1).kind != NodeKind::List) {
+            OutputBuffer buffer(out);
+            Print(doc, buffer);
+            return;
+        }
+
+        // Границы диапазонов - потомки корня. Цепочка соседей из таблицы принимается, только пока
+        // id растут и узлы действительно ссылаются на корень, иначе диапазон просто длиннее
+        std::vector<uint32_t> bounds{2};
+        for (uint32_t prev = 1, child = doc.GetNode(1).first_child; child > prev && child <= size;
+             prev = child, child = doc.GetNode(child).next_sibling) {
+            if (doc.GetNode(child).parent_id == 1 && child - bounds.back() >= options.min_chunk_nodes) {
+                bounds.push_back(child);
+            }
+        }
+        bounds.push_back(size + 1);
+
+        // Строка корня. При последовательном выводе на каждой границе стек сворачивается до 0 и корня,
+        // поэтому все диапазоны начинаются с одинакового стека
+        std::vector<uint32_t> open{0};
+        {
+            OutputBuffer header(out, kLineBufferCapacity);
+            PrintRange(doc, 1, 1, open, header);
+        }
+        const size_t count = bounds.size() - 1;
+        WriteParallel(out, count, threads, [&](size_t i, OutputBuffer &part) {
+            std::vector<uint32_t> range_open = open;
+            PrintRange(doc, bounds[i], bounds[i + 1] - 1, range_open, part);
+            if (i + 1 < count && range_open.size() == 1) {
+                // диапазон закрыл корень: последовательный вывод остановился бы на следующей границе
+                ThrowFormatError();
+            }
+        });
+    }
+
+} //namespace parser
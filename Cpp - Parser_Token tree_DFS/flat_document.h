@@ -0,0 +1,136 @@
+#pragma once
+
+#include "parser.h"
+#include "symbol_table.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace parser {
+
+    // Вид значения узла
+    enum class NodeKind : uint8_t {
+        Null,
+        String,
+        List
+    };
+
+    // Ссылка на строку в общем пуле документа
+    struct PoolString {
+        uint64_t offset = 0;
+        uint32_t size = 0;
+    };
+
+    // Узел плоского представления. Узлы лежат в одной таблице в порядке обхода в глубину,
+    // поэтому id узла совпадает с id, который назначает парсер, а индекс в таблице равен id - 1.
+    // Связи хранятся как id (0 - связи нет). Поддерево узла занимает непрерывный диапазон
+    // id [id, last_descendant], поэтому его можно пропустить или выделить без обхода
+    struct FlatNode {
+        uint32_t parent_id = 0;
+        uint32_t first_child = 0;
+        uint32_t next_sibling = 0;
+        uint32_t last_descendant = 0;
+        uint32_t name = 0;  // символ имени в таблице имен документа
+        NodeKind kind = NodeKind::Null;
+        PoolString value;   // только для строковых узлов
+    };
+
+    // Таблица узлов и пул строк в чужой памяти (FlatDocument, снимок в отображенном файле).
+    // Общий интерфейс чтения для всех плоских представлений
+    class FlatView {
+    public:
+        FlatView() = default;
+
+        // symbols - строки имен в пуле, по символу
+        FlatView(const FlatNode *nodes, size_t size, const PoolString *symbols, size_t symbol_count,
+                 std::string_view pool);
+
+        size_t Size() const;
+
+        // id от 1 до Size(), для остальных - std::out_of_range
+        const FlatNode &GetNode(uint32_t id) const;
+
+        std::string_view GetName(uint32_t id) const;
+
+        std::string_view GetValue(uint32_t id) const;
+
+        // имя по символу, для неизвестного символа - std::out_of_range
+        std::string_view GetSymbol(uint32_t symbol) const;
+
+        size_t SymbolCount() const;
+
+        const PoolString *GetSymbols() const;
+
+        std::string_view GetPool() const;
+
+    private:
+        std::string_view GetString(PoolString str) const;
+
+        const FlatNode *nodes_ = nullptr;
+        size_t size_ = 0;
+        const PoolString *symbols_ = nullptr;
+        size_t symbol_count_ = 0;
+        std::string_view pool_;
+    };
+
+    // Документ в виде плоской таблицы узлов и общего пула строк.
+    // Вместо выделения памяти на каждый список и каждое имя - два непрерывных буфера.
+    // Имена хранятся в пуле по одному разу: узел держит 32-битный символ из таблицы имен документа,
+    // поэтому имена сравниваются как числа, а повторяющиеся имена не занимают места в пуле
+    class FlatDocument {
+    public:
+        FlatDocument() = default;
+
+        size_t Size() const;
+
+        // id от 1 до Size()
+        const FlatNode &GetNode(uint32_t id) const;
+
+        std::string_view GetName(uint32_t id) const;
+
+        std::string_view GetValue(uint32_t id) const;
+
+        const std::vector<FlatNode> &GetNodes() const;
+
+        // действительно до следующего изменения документа
+        FlatView View() const;
+
+        // Добавляет узел в конец таблицы и связывает его с родителем и предыдущим соседом.
+        // Узлы должны добавляться в порядке обхода в глубину. Возвращает id нового узла
+        uint32_t AddNode(uint32_t parent_id, uint32_t prev_sibling, std::string_view name,
+                         NodeKind kind, std::string_view value = {});
+
+        // Закрывает список после добавления всего его поддерева: запоминает последний узел поддерева
+        void CloseList(uint32_t id);
+
+    private:
+        PoolString AddString(std::string_view text);
+
+        std::vector<FlatNode> nodes_;
+        std::string pool_;
+        SymbolTable names_;
+        std::vector<PoolString> symbols_;   // строки символов names_ в пуле
+    };
+
+    // Разбор буфера сразу в плоское представление
+    FlatDocument LoadFlat(std::string_view input);
+
+    // Перевод дерева в плоское представление, узлы нумеруются в порядке обхода
+    FlatDocument Flatten(const Document &doc);
+
+    // Вывод таблицы одним последовательным проходом, формат совпадает с Print(const Document &, ...)
+    void Print(const FlatDocument &doc, std::ostream &out);
+
+    void Print(const FlatDocument &doc, OutputBuffer &out);
+
+    void Print(const FlatView &doc, OutputBuffer &out);
+
+    // Параллельный вывод: таблица делится на диапазоны по границам поддеревьев потомков корня
+    // (не меньше options.min_chunk_nodes узлов), диапазоны форматируются на пуле потоков и пишутся по порядку.
+    // Вывод совпадает с Print, в том числе ошибка для поврежденной таблицы
+    void PrintParallel(const FlatView &doc, std::ostream &out, const ParallelOptions &options = {});
+
+} //namespace parser
@@ -0,0 +1,403 @@
+#include "incremental.h"
+#include "lexer.h"
+#include "structural_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace parser {
+
+    namespace {
+
+        struct Span {
+            size_t begin = 0;
+            size_t end = 0;
+            size_t body = 0;
+        };
+
+        // Границы узлов уже разобранного текста region (последовательность узлов, смещение base)
+        // в порядке их '=' - то есть в порядке id. Позиции берутся из структурного индекса
+        std::vector<Span> FindSpans(std::string_view region, size_t base) {
+            std::vector<Span> spans;
+            std::vector<size_t> open;       // незакрытые списки
+            size_t assign = 0;              // позиция '=' последнего узла
+            bool expect_value = false;
+            bool in_string = false;
+
+            // конец значения null: ключевое слово после '=' и пробелов
+            const auto null_end = [region](size_t pos) {
+                ++pos;
+                while (IsSpace(region[pos])) {
+                    ++pos;
+                }
+                return pos + 4;
+            };
+
+            StructuralScanner scanner(region);
+            std::vector<uint64_t> structurals, specials;
+            while (scanner.ScanChunk(structurals, specials)) {
+                for (const uint64_t pos: structurals) {
+                    const char c = region[pos];
+                    if (in_string) {
+                        // закрывающая кавычка
+                        spans.back().end = base + pos + 1;
+                        in_string = false;
+                        continue;
+                    }
+                    if (expect_value) {
+                        expect_value = false;
+                        if (c == '"') {
+                            in_string = true;
+                            continue;
+                        }
+                        if (c == '{') {
+                            spans.back().body = base + pos + 1;
+                            open.push_back(spans.size() - 1);
+                            continue;
+                        }
+                        spans.back().end = base + null_end(assign);
+                    }
+                    if (c == '=') {
+                        size_t begin = pos;
+                        while (begin > 0 && IsSpace(region[begin - 1])) {
+                            --begin;
+                        }
+                        while (begin > 0 && IsNameChar(region[begin - 1])) {
+                            --begin;
+                        }
+                        spans.push_back({base + begin, 0, 0});
+                        assign = pos;
+                        expect_value = true;
+                    } else if (c == '}' && !open.empty()) {
+                        spans[open.back()].end = base + pos + 1;
+                        open.pop_back();
+                    }
+                }
+                structurals.clear();
+                specials.clear();
+            }
+            if (expect_value) {
+                spans.back().end = base + null_end(assign);
+            }
+            return spans;
+        }
+
+        // Дерево правится на месте: старые поддеревья освобождаются, новые вставляются, поэтому
+        // оно строится в общей куче, а не в арене, которая освобождается только целиком.
+        // Имена правок добавляются в таблицу документа и освобождаются вместе с ним
+        Document LoadEditable(std::string_view text) {
+            IdAllocator ids;
+            return Load(text, ids, std::pmr::get_default_resource());
+        }
+
+    } // namespace
+
+    IncrementalDocument::IncrementalDocument(std::string text)
+            : text_(std::move(text)), doc_(LoadEditable(text_)) {
+        Rebuild();
+    }
+
+    // корень документа лежит отдельно от объекта Document, поэтому указатели в nodes_ остаются верны
+    IncrementalDocument::IncrementalDocument(IncrementalDocument &&other) noexcept = default;
+
+    IncrementalDocument &IncrementalDocument::operator=(IncrementalDocument &&other) noexcept = default;
+
+    const Document &IncrementalDocument::GetDocument() const {
+        return doc_;
+    }
+
+    std::string_view IncrementalDocument::GetText() const {
+        return text_;
+    }
+
+    const IncrementalDocument::NodeInfo &IncrementalDocument::Info(int id) const {
+        return nodes_[id - 1];
+    }
+
+    size_t IncrementalDocument::Begin(int id) const {
+        return nodes_[id - 1].begin + PendingShift(id - 1);
+    }
+
+    size_t IncrementalDocument::End(int id) const {
+        return nodes_[id - 1].end + PendingShift(id - 1);
+    }
+
+    size_t IncrementalDocument::Body(int id) const {
+        return nodes_[id - 1].body + PendingShift(id - 1);
+    }
+
+    void IncrementalDocument::ShiftFrom(size_t index, ptrdiff_t delta) {
+        shifted_ = true;
+        for (size_t i = index + 1; i < shifts_.size(); i += i & (~i + 1)) {
+            shifts_[i] += delta;
+        }
+    }
+
+    ptrdiff_t IncrementalDocument::PendingShift(size_t index) const {
+        ptrdiff_t shift = 0;
+        for (size_t i = index + 1; i > 0; i -= i & (~i + 1)) {
+            shift += shifts_[i];
+        }
+        return shift;
+    }
+
+    void IncrementalDocument::FlushShifts() {
+        if (!shifted_) {
+            return;
+        }
+        // суммы по отрезкам дерева - обратно в сдвиги отдельных индексов, затем префиксные суммы
+        for (size_t i = shifts_.size(); i-- > 1;) {
+            const size_t parent = i + (i & (~i + 1));
+            if (parent < shifts_.size()) {
+                shifts_[parent] -= shifts_[i];
+            }
+        }
+        size_t shift = 0;
+        for (size_t i = 1; i < shifts_.size(); ++i) {
+            shift += static_cast<size_t>(shifts_[i]);
+            shifts_[i] = 0;
+            NodeInfo &info = nodes_[i - 1];
+            info.begin += shift;
+            info.end += shift;
+            info.body += shift;
+        }
+        shifted_ = false;
+    }
+
+    void IncrementalDocument::Rebuild() {
+        nodes_ = Describe(doc_.root_, 1, 0, 0, text_, 0);
+        shifts_.assign(nodes_.size() + 1, 0);
+        shifted_ = false;
+    }
+
+    std::vector<IncrementalDocument::NodeInfo> IncrementalDocument::Describe(
+            Node *first, size_t count, int parent_id, int depth, std::string_view region, size_t base) const {
+        std::vector<NodeInfo> infos;
+        if (count == 0) {
+            return infos;
+        }
+        const int first_id = first->GetId();
+
+        // обход в глубину по явному стеку дает узлы в порядке id
+        std::vector<NodeInfo> stack;
+        for (size_t i = count; i-- > 0;) {
+            stack.push_back({first + i, parent_id, depth});
+        }
+        while (!stack.empty()) {
+            NodeInfo info = stack.back();
+            stack.pop_back();
+            info.last_descendant = info.node->GetId();
+            infos.push_back(info);
+            if (info.node->IsArray()) {
+                Array &list = std::get<Array>(*info.node);
+                for (size_t i = list.size(); i-- > 0;) {
+                    stack.push_back({&list[i], info.node->GetId(), info.depth + 1});
+                }
+            }
+        }
+        // последний узел поддерева - от потомков к родителям
+        for (size_t i = infos.size(); i-- > 0;) {
+            const int parent = infos[i].parent_id - first_id;
+            if (infos[i].parent_id >= first_id) {
+                infos[parent].last_descendant = std::max(infos[parent].last_descendant, infos[i].last_descendant);
+            }
+        }
+
+        const std::vector<Span> spans = FindSpans(region, base);
+        for (size_t i = 0; i < infos.size() && i < spans.size(); ++i) {
+            infos[i].begin = spans[i].begin;
+            infos[i].end = spans[i].end;
+            infos[i].body = spans[i].body;
+        }
+        return infos;
+    }
+
+    EditResult IncrementalDocument::ApplyEdit(size_t begin, size_t end, std::string_view replacement) {
+        using namespace std::literals;
+
+        if (begin > end || end > text_.size()) {
+            throw std::out_of_range("IncrementalDocument::ApplyEdit()"s);
+        }
+
+        // Наименьший список, в теле которого (между скобками) лежит правка
+        const auto inside_body = [this, begin, end](int id) {
+            return Info(id).node->IsArray() && Body(id) <= begin && end < End(id);
+        };
+        int list_id = inside_body(1) ? 1 : 0;
+        size_t first = 0, last = 0;     // затронутые потомки списка: [first, last)
+        while (list_id) {
+            const Array &children = Info(list_id).node->AsArray();
+            // потомки, чьи границы пересекаются с правкой или касаются ее
+            first = std::partition_point(children.begin(), children.end(), [this, begin](const Node &child) {
+                return End(child.GetId()) < begin;
+            }) - children.begin();
+            last = std::partition_point(children.begin() + first, children.end(), [this, end](const Node &child) {
+                return Begin(child.GetId()) <= end;
+            }) - children.begin();
+            if (last == first + 1 && inside_body(children[first].GetId())) {
+                list_id = children[first].GetId();
+                continue;
+            }
+            break;
+        }
+
+        if (!list_id) {
+            // правка задевает заголовок или скобки корня
+            return ReplaceAll(begin, end, replacement);
+        }
+
+        Array &children = std::get<Array>(*Info(list_id).node);
+
+        // Заменяемый участок текста: затронутые потомки целиком и промежутки до соседей.
+        // Промежутки - пробелы и необязательная запятая перед следующим узлом, поэтому участок
+        // разбирается отдельно так же, как в составе всего списка
+        const size_t region_begin = first > 0 ? End(children[first - 1].GetId()) : Body(list_id);
+        const size_t region_end = last < children.size() ? Begin(children[last].GetId()) : End(list_id) - 1;
+        int first_id;
+        int old_count = 0;
+        if (first < last) {
+            first_id = children[first].GetId();
+            old_count = Info(children[last - 1].GetId()).last_descendant - first_id + 1;
+        } else {
+            first_id = first > 0 ? Info(children[first - 1].GetId()).last_descendant + 1 : list_id + 1;
+        }
+        std::string region = text_.substr(region_begin, begin - region_begin) + std::string(replacement)
+                             + text_.substr(end, region_end - end);
+        if (last < children.size()) {
+            // запятая в конце участка относится к следующему соседу
+            const size_t tail = region.find_last_not_of(" \t\n\r\v\f");
+            if (tail != std::string::npos && region[tail] == ',') {
+                region.resize(tail);
+            }
+        }
+
+        IdAllocator ids(first_id);
+        Array fresh;
+        try {
+            fresh = LoadSequence(region, ids, list_id, doc_.names_->Front(), std::pmr::get_default_resource());
+        } catch (const ParsingError &) {
+            // Участок не разбирается отдельно. Весь текст при этом может оказаться верным
+            // (например, лишняя '}' закрыла корень, а остаток после корня не разбирается),
+            // поэтому решает полный разбор
+            return ReplaceAll(begin, end, replacement);
+        }
+        if (children.size() - (last - first) + fresh.size() == 0) {
+            // список остался пустым
+            return ReplaceAll(begin, end, replacement);
+        }
+        const int new_count = ids.Count();
+        const int id_delta = new_count - old_count;
+        const auto byte_delta = static_cast<ptrdiff_t>(replacement.size()) - static_cast<ptrdiff_t>(end - begin);
+
+        // Узлы после участка: id, родители (если они тоже после участка) и границы в тексте сдвигаются.
+        // Потомки списка после участка переезжают внутри его массива, указатели на них обновляются
+        for (size_t i = first; i < last; ++i) {
+            DestroyTree(children[i]);
+        }
+        const size_t fresh_size = fresh.size();
+        if (fresh_size == last - first) {
+            std::move(fresh.begin(), fresh.end(), children.begin() + static_cast<ptrdiff_t>(first));
+        } else {
+            const Node *old_data = children.data();
+            children.erase(children.begin() + static_cast<ptrdiff_t>(first),
+                           children.begin() + static_cast<ptrdiff_t>(last));
+            children.insert(children.begin() + static_cast<ptrdiff_t>(first),
+                            std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+            // Потомки после участка сдвинулись, а при перевыделении массива переехали и те, что перед ним.
+            // id у них еще старые
+            const size_t moved_from = children.data() == old_data ? first : 0;
+            for (size_t i = moved_from; i < first; ++i) {
+                nodes_[children[i].GetId() - 1].node = &children[i];
+            }
+            for (size_t i = first + fresh_size; i < children.size(); ++i) {
+                nodes_[children[i].GetId() - 1].node = &children[i];
+            }
+        }
+        const int after = first_id + old_count;   // первый старый id после участка
+        if (id_delta) {
+            // id меняются у всего хвоста, поэтому за тот же проход вносятся и накопленные сдвиги границ
+            FlushShifts();
+            for (size_t i = after - 1; i < nodes_.size(); ++i) {
+                NodeInfo &info = nodes_[i];
+                if (info.parent_id >= after) {
+                    info.parent_id += id_delta;
+                }
+                info.last_descendant += id_delta;
+                info.begin += byte_delta;
+                info.end += byte_delta;
+                info.body += byte_delta;
+                info.node->SetId(info.node->GetId() + id_delta);
+            }
+        } else if (byte_delta) {
+            ShiftFrom(after - 1, byte_delta);
+        }
+        // список и его предки содержат участок
+        for (int id = list_id; id; id = Info(id).parent_id) {
+            nodes_[id - 1].last_descendant += id_delta;
+            nodes_[id - 1].end += byte_delta;
+        }
+
+        std::vector<NodeInfo> described = Describe(children.data() + first, fresh_size, list_id,
+                                                   Info(list_id).depth + 1, region, region_begin);
+        const size_t described_at = first_id - 1;
+        if (id_delta == 0) {
+            // границы в таблице хранятся без накопленных сдвигов
+            for (size_t i = 0; i < described.size(); ++i) {
+                const auto shift = static_cast<size_t>(PendingShift(described_at + i));
+                described[i].begin -= shift;
+                described[i].end -= shift;
+                described[i].body -= shift;
+            }
+        } else {
+            // хвост таблицы переезжает одним перемещением
+            const auto tail = static_cast<ptrdiff_t>(described_at + old_count);
+            const size_t tail_size = nodes_.size() - static_cast<size_t>(tail);
+            if (id_delta > 0) {
+                nodes_.resize(nodes_.size() + id_delta);
+                std::move_backward(nodes_.begin() + tail, nodes_.begin() + tail + static_cast<ptrdiff_t>(tail_size),
+                                   nodes_.end());
+            } else {
+                std::move(nodes_.begin() + tail, nodes_.end(), nodes_.begin() + tail + id_delta);
+                nodes_.resize(nodes_.size() + id_delta);
+            }
+            shifts_.resize(nodes_.size() + 1);
+        }
+        std::copy(described.begin(), described.end(), nodes_.begin() + static_cast<ptrdiff_t>(described_at));
+        text_.replace(begin, end - begin, replacement);
+        // дерево изменено на месте, запомненный хеш устарел
+        doc_.hash_ = 0;
+
+        return {first_id, old_count, new_count, list_id};
+    }
+
+    EditResult IncrementalDocument::ReplaceAll(size_t begin, size_t end, std::string_view replacement) {
+        std::string text = text_;
+        text.replace(begin, end - begin, replacement);
+        Document rebuilt = LoadEditable(text);
+
+        const int old_count = static_cast<int>(nodes_.size());
+        text_ = std::move(text);
+        // старое дерево разбирается без рекурсии
+        doc_ = std::move(rebuilt);
+        Rebuild();
+        return {1, old_count, static_cast<int>(nodes_.size()), 0};
+    }
+
+    void IncrementalDocument::PrintLines(int first_id, int count, OutputBuffer &out) const {
+        for (int id = first_id; id < first_id + count; ++id) {
+            const NodeInfo &info = Info(id);
+            const Node &node = *info.node;
+            WriteNodePrefix(out, 2 * info.depth, id, info.parent_id, node.GetName());
+            if (node.IsArray()) {
+                PrintListSummary(node.AsArray(), out);
+            } else if (node.IsString()) {
+                out.WriteEscaped(node.AsString());
+                out.Put('\n');
+            } else {
+                out.Write("null\n");
+            }
+        }
+    }
+
+} //namespace parser
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "output_buffer.h"
+#include "parser.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace parser {
+
+    // Какие строки вывода Print изменила правка. Строка с номером k (с единицы) - узел с id k
+    struct EditResult {
+        // строки [first_line, first_line + removed_lines) старого вывода заменены на
+        // [first_line, first_line + added_lines) нового
+        int first_line = 0;
+        int removed_lines = 0;
+        int added_lines = 0;
+        // строка списка, в котором разобраны узлы: перечень имен его потомков мог измениться.
+        // 0 - документ разобран заново целиком
+        int list_line = 0;
+        // При added_lines != removed_lines id всех строк после замененных сдвинуты на разницу,
+        // поэтому эти строки тоже изменились
+        bool Renumbered() const {
+            return added_lines != removed_lines;
+        }
+    };
+
+    // Документ вместе с исходным текстом для повторного разбора после правок.
+    // Для каждого узла хранятся его границы в тексте, поэтому правка находит наименьший список,
+    // внутри тела которого она лежит, и разбирает заново только затронутых ею потомков этого списка.
+    // Новые узлы встают в дерево на место старых, id и ссылки на родителей после них сдвигаются.
+    // Правка, не меняющая числа узлов (значение другой длины), не проходит по хвосту таблицы:
+    // сдвиг границ копится в дереве Фенвика, остается только сдвиг хвоста самого текста.
+    // Правка, добавляющая или удаляющая узлы, перенумеровывает все узлы дерева после себя - это O(n)
+    class IncrementalDocument {
+    public:
+        // бросает ParsingError, как Load
+        explicit IncrementalDocument(std::string text);
+
+        // таблица узлов ссылается на узлы дерева, поэтому документ только перемещается
+        IncrementalDocument(const IncrementalDocument &) = delete;
+
+        IncrementalDocument &operator=(const IncrementalDocument &) = delete;
+
+        IncrementalDocument(IncrementalDocument &&other) noexcept;
+
+        IncrementalDocument &operator=(IncrementalDocument &&other) noexcept;
+
+        const Document &GetDocument() const;
+
+        std::string_view GetText() const;
+
+        // Заменяет байты [begin, end) текста на replacement. Если результат не разбирается,
+        // бросает ParsingError, документ и текст не меняются. Неверный диапазон - std::out_of_range
+        EditResult ApplyEdit(size_t begin, size_t end, std::string_view replacement);
+
+        // строки вывода Print для id [first_id, first_id + count)
+        void PrintLines(int first_id, int count, OutputBuffer &out) const;
+
+    private:
+        // узел с id = индекс + 1
+        struct NodeInfo {
+            Node *node = nullptr;
+            int parent_id = 0;
+            int depth = 0;
+            int last_descendant = 0;   // id последнего узла поддерева
+            // границы в тексте без сдвигов из shifts_
+            size_t begin = 0;          // начало имени
+            size_t end = 0;            // позиция за значением
+            size_t body = 0;           // для списков: позиция за '{', у прочих узлов не читается
+        };
+
+        // границы узла в тексте
+        size_t Begin(int id) const;
+
+        size_t End(int id) const;
+
+        size_t Body(int id) const;
+
+        // сдвигает границы узлов с индексами от index на delta байт
+        void ShiftFrom(size_t index, ptrdiff_t delta);
+
+        // накопленный сдвиг узла с индексом index
+        ptrdiff_t PendingShift(size_t index) const;
+
+        // вносит накопленные сдвиги в таблицу
+        void FlushShifts();
+
+        // таблица узлов по всему дереву
+        void Rebuild();
+
+        // правка с полным разбором итогового текста
+        EditResult ReplaceAll(size_t begin, size_t end, std::string_view replacement);
+
+        // Таблица узлов поддеревьев count соседних узлов от first (id подряд) с границами
+        // из текста region, который начинается со смещения base
+        std::vector<NodeInfo> Describe(Node *first, size_t count, int parent_id, int depth,
+                                       std::string_view region, size_t base) const;
+
+        const NodeInfo &Info(int id) const;
+
+        std::string text_;
+        Document doc_;
+        std::vector<NodeInfo> nodes_;
+        // дерево Фенвика по индексам nodes_ (с единицы): сдвиг узла - сумма префикса
+        std::vector<ptrdiff_t> shifts_;
+        bool shifted_ = false;
+    };
+
+} //namespace parser
@@ -0,0 +1,252 @@
+#include "lazy_document.h"
+#include "document_index.h"
+#include "lexer.h"
+#include "structural_index.h"
+
+#include <algorithm>
+
+namespace parser {
+
+    namespace {
+
+        size_t SkipSpaces(std::string_view input, size_t pos, size_t end) {
+            while (pos < end && IsSpace(input[pos])) {
+                ++pos;
+            }
+            return pos;
+        }
+
+        // Промежуток [begin, end) должен состоять только из пробельных символов
+        void ExpectSpaces(std::string_view input, size_t begin, size_t end) {
+            if (SkipSpaces(input, begin, end) != end) {
+                ThrowFormatError();
+            }
+        }
+
+        // Промежуток перед '=' потомка: [','] имя, вокруг - пробельные символы. Возвращает позицию имени
+        size_t ExpectName(std::string_view input, size_t begin, size_t end) {
+            size_t pos = SkipSpaces(input, begin, end);
+            if (pos < end && input[pos] == ',') {
+                pos = SkipSpaces(input, pos + 1, end);
+            }
+            const size_t name = pos;
+            if (pos == end || !IsNameStart(input[pos])) {
+                ThrowFormatError();
+            }
+            while (pos < end && IsNameChar(input[pos])) {
+                ++pos;
+            }
+            ExpectSpaces(input, pos, end);
+            return name;
+        }
+
+        std::string_view NameAt(std::string_view input, size_t pos) {
+            size_t end = pos;
+            while (end < input.size() && IsNameChar(input[end])) {
+                ++end;
+            }
+            return input.substr(pos, end - pos);
+        }
+
+        // Значение null в промежутке [begin, end): возвращает позицию за ним
+        size_t ExpectNull(std::string_view input, size_t begin, size_t end) {
+            using namespace std::literals;
+
+            const size_t pos = SkipSpaces(input, begin, end);
+            if (input.substr(pos, 4) != "null"sv || pos + 4 > end
+                || (pos + 4 < input.size() && IsNameChar(input[pos + 4]))) {
+                ThrowFormatError();
+            }
+            return pos + 4;
+        }
+
+    } // namespace
+
+    LazyDocument::LazyDocument(std::string_view input)
+            : input_(input) {
+        using namespace std::literals;
+
+        // заголовок корня "name = " и начало значения
+        Lexer lexer(input_);
+        const Token name = lexer.Next();
+        if (name.type != TokenType::Name || lexer.Next().type != TokenType::Assign) {
+            ThrowFormatError();
+        }
+        root_.name = name.text;
+        root_.id = 1;
+        root_.begin = static_cast<size_t>(name.text.data() - input_.data());
+
+        const Token value = lexer.Next();
+        if (value.type == TokenType::ListBegin) {
+            root_.kind = NodeKind::List;
+            root_.body = lexer.Position();
+            // конец корня станет известен при первом просмотре его тела
+            root_.end = input_.size();
+        } else if (value.type == TokenType::String) {
+            root_.kind = NodeKind::String;
+            root_.end = lexer.Position();
+        } else if (value.type == TokenType::Name && value.text == "null"sv) {
+            root_.kind = NodeKind::Null;
+            root_.end = lexer.Position();
+        } else {
+            ThrowFormatError();
+        }
+    }
+
+    const LazyEntry &LazyDocument::GetRoot() const {
+        return root_;
+    }
+
+    const std::vector<LazyEntry> &LazyDocument::GetChildren(const LazyEntry &entry) {
+        static const std::vector<LazyEntry> empty;
+        if (entry.kind != NodeKind::List) {
+            return empty;
+        }
+        const auto it = children_.find(entry.id);
+        if (it != children_.end()) {
+            return it->second;
+        }
+        size_t end = 0;
+        std::vector<LazyEntry> children = ScanChildren(entry, end);
+        if (entry.id == root_.id) {
+            // граница корня становится известна только сейчас
+            root_.end = end;
+        }
+        return children_.emplace(entry.id, std::move(children)).first->second;
+    }
+
+    std::vector<LazyEntry> LazyDocument::ScanChildren(const LazyEntry &list, size_t &list_end) const {
+        // состояние разбора непосредственных потомков
+        enum class State {
+            ExpectAssign,   // ждем '=' очередного потомка (или '}' списка)
+            ExpectValue,    // после '=': кавычка, '{' или null
+            InString,       // внутри строкового значения
+            InList          // внутри вложенного списка, depth > 0
+        };
+
+        std::vector<LazyEntry> children;
+        const std::string_view body = input_.substr(list.body);
+        StructuralScanner scanner(body);
+        std::vector<uint64_t> structurals, specials;
+
+        State state = State::ExpectAssign;
+        size_t prev_end = list.body;    // конец предыдущей разобранной части
+        int next_id = list.id + 1;
+        int depth = 0;
+        int nested = 0;                 // узлов во вложенном списке
+        // порции сканирования растут, чтобы маленький список не сканировал лишнего
+        size_t chunk = 4096;
+
+        while (scanner.ScanChunk(structurals, specials, chunk)) {
+            chunk = std::min<size_t>(chunk * 2, size_t{1} << 20);
+            for (const uint64_t offset: structurals) {
+                const size_t pos = list.body + offset;
+                const char c = input_[pos];
+
+                if (state == State::InList) {
+                    if (c == '{') {
+                        ++depth;
+                    } else if (c == '=') {
+                        ++nested;
+                    } else if (c == '}' && --depth == 0) {
+                        LazyEntry &child = children.back();
+                        child.end = pos + 1;
+                        next_id += 1 + nested;
+                        prev_end = pos + 1;
+                        state = State::ExpectAssign;
+                    }
+                    continue;
+                }
+                if (state == State::InString) {
+                    // внутри строки структурным бывает только закрывающая кавычка
+                    children.back().end = pos + 1;
+                    ++next_id;
+                    prev_end = pos + 1;
+                    state = State::ExpectAssign;
+                    continue;
+                }
+                if (state == State::ExpectValue) {
+                    LazyEntry &child = children.back();
+                    if (c == '"') {
+                        ExpectSpaces(input_, prev_end, pos);
+                        child.kind = NodeKind::String;
+                        state = State::InString;
+                        continue;
+                    }
+                    if (c == '{') {
+                        ExpectSpaces(input_, prev_end, pos);
+                        child.kind = NodeKind::List;
+                        child.body = pos + 1;
+                        depth = 1;
+                        nested = 0;
+                        state = State::InList;
+                        continue;
+                    }
+                    // ни кавычки, ни скобки - значение null, а c относится уже к следующему узлу
+                    child.kind = NodeKind::Null;
+                    child.end = ExpectNull(input_, prev_end, pos);
+                    ++next_id;
+                    prev_end = child.end;
+                    state = State::ExpectAssign;
+                }
+
+                // State::ExpectAssign
+                if (c == '=') {
+                    LazyEntry child;
+                    child.begin = ExpectName(input_, prev_end, pos);
+                    child.name = NameAt(input_, child.begin);
+                    child.id = next_id;
+                    child.parent_id = list.id;
+                    children.push_back(child);
+                    prev_end = pos + 1;
+                    state = State::ExpectValue;
+                } else if (c == '}' && !children.empty()) {
+                    // конец списка; пустой список не допускается
+                    ExpectSpaces(input_, prev_end, pos);
+                    list_end = pos + 1;
+                    return children;
+                } else {
+                    ThrowFormatError();
+                }
+            }
+            structurals.clear();
+            specials.clear();
+        }
+        // вход закончился внутри списка
+        ThrowFormatError();
+    }
+
+    const LazyEntry *LazyDocument::FindByPath(std::string_view path) {
+        const std::vector<PathSegment> segments = SplitPath(path);
+        if (root_.name != segments[0].name || segments[0].index != 0) {
+            return nullptr;
+        }
+        const LazyEntry *entry = &root_;
+        for (size_t i = 1; i < segments.size(); ++i) {
+            const LazyEntry *found = nullptr;
+            size_t k = segments[i].index;
+            for (const LazyEntry &child: GetChildren(*entry)) {
+                if (child.name == segments[i].name && k-- == 0) {
+                    found = &child;
+                    break;
+                }
+            }
+            if (!found) {
+                return nullptr;
+            }
+            entry = found;
+        }
+        return entry;
+    }
+
+    const Node &LazyDocument::GetNode(const LazyEntry &entry) {
+        auto it = nodes_.find(entry.id);
+        if (it == nodes_.end()) {
+            // текст узла разбирается отдельно, нумерация продолжается с его id
+            IdAllocator ids(entry.id);
+            it = nodes_.emplace(entry.id, Load(input_.substr(entry.begin, entry.end - entry.begin), ids)).first;
+        }
+        return it->second.GetRoot();
+    }
+
+} //namespace parser
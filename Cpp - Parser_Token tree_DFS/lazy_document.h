@@ -0,0 +1,60 @@
+#pragma once
+
+#include "flat_document.h"
+#include "parser.h"
+
+#include <cstddef>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace parser {
+
+    // Узел ленивого документа: имя, id, вид значения и границы текста узла во входном буфере
+    struct LazyEntry {
+        std::string_view name;
+        int id = 0;
+        int parent_id = 0;
+        NodeKind kind = NodeKind::Null;
+        size_t begin = 0;   // начало имени узла
+        size_t end = 0;     // позиция за последним символом значения
+        size_t body = 0;    // для списков: позиция за открывающей скобкой
+    };
+
+    // Ленивый документ: при открытии разбирается только заголовок корня.
+    // Непосредственные потомки списка находятся при первом обращении к нему одним проходом
+    // структурного сканера по телу списка: вложенные списки пропускаются по парным скобкам
+    // (с учетом строк и escape-последовательностей), запоминаются только их границы и число узлов
+    // в них, поэтому id совпадают с Load(input). Дерево Node строится только для запрошенных поддеревьев.
+    // Время и память зависят от того, к чему обращались, а не от размера входа.
+    // Ошибки формата внутри пропущенных поддеревьев обнаруживаются, когда к ним обращаются.
+    // Буфер принадлежит вызывающему и должен жить дольше документа. Методы не потокобезопасны
+    class LazyDocument {
+    public:
+        // бросает ParsingError, если заголовок корня неверен
+        explicit LazyDocument(std::string_view input);
+
+        const LazyEntry &GetRoot() const;
+
+        // Непосредственные потомки узла; пустой список для строк и null.
+        // Ссылка действительна, пока жив документ
+        const std::vector<LazyEntry> &GetChildren(const LazyEntry &entry);
+
+        // Поиск по пути вида "shape/vertices/point[2]/x" (см. SplitPath). nullptr, если узла нет
+        const LazyEntry *FindByPath(std::string_view path);
+
+        // Узел со всем поддеревом, разбирается при первом обращении. Ссылка действительна, пока жив документ
+        const Node &GetNode(const LazyEntry &entry);
+
+    private:
+        // потомки списка и позиция за его закрывающей скобкой
+        std::vector<LazyEntry> ScanChildren(const LazyEntry &list, size_t &list_end) const;
+
+        std::string_view input_;
+        LazyEntry root_;
+        // по id узла
+        std::unordered_map<int, std::vector<LazyEntry>> children_;
+        std::unordered_map<int, Document> nodes_;
+    };
+
+} //namespace parser
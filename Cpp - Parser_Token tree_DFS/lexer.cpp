@@ -0,0 +1,127 @@
+#include "lexer.h"
+
+namespace parser {
+
+    Lexer::Lexer(std::string_view input)
+            : input_(input) {
+    }
+
+    Lexer::Lexer(std::string_view input, size_t pos)
+            : input_(input), pos_(pos) {
+    }
+
+    size_t Lexer::Position() const {
+        return pos_;
+    }
+
+    void Lexer::SkipSpaces() {
+        while (pos_ < input_.size() && IsSpace(input_[pos_])) {
+            ++pos_;
+        }
+    }
+
+    Token Lexer::Next() {
+        SkipSpaces();
+        if (pos_ == input_.size()) {
+            return {TokenType::End, {}};
+        }
+        const char c = input_[pos_];
+        switch (c) {
+            case '=':
+                return {TokenType::Assign, input_.substr(pos_++, 1)};
+            case '{':
+                return {TokenType::ListBegin, input_.substr(pos_++, 1)};
+            case '}':
+                return {TokenType::ListEnd, input_.substr(pos_++, 1)};
+            case ',':
+                return {TokenType::Separator, input_.substr(pos_++, 1)};
+            case '"':
+                ++pos_;
+                return ReadString();
+            default:
+                if (IsNameStart(c)) {
+                    return ReadName();
+                }
+                return {TokenType::Invalid, input_.substr(pos_, 1)};
+        }
+    }
+
+    Token Lexer::ReadName() {
+        const size_t begin = pos_;
+        while (pos_ < input_.size() && IsNameChar(input_[pos_])) {
+            ++pos_;
+        }
+        return {TokenType::Name, input_.substr(begin, pos_ - begin)};
+    }
+
+    Token Lexer::ReadString() {
+        const size_t begin = pos_;
+        bool has_escapes = false;
+        for (; pos_ < input_.size(); ++pos_) {
+            const char ch = input_[pos_];
+            if (ch == '"') {
+                // Быстрый путь: строка без escape-последовательностей отдается без копирования
+                const std::string_view raw = input_.substr(begin, pos_++ - begin);
+                if (!has_escapes) {
+                    return {TokenType::String, raw};
+                }
+                if (!Unescape(raw, unescaped_)) {
+                    return {TokenType::Invalid, raw};
+                }
+                return {TokenType::String, unescaped_};
+            } else if (ch == '\\') {
+                // экранированный символ пропускаем, его проверит Unescape
+                has_escapes = true;
+                if (++pos_ == input_.size()) {
+                    break;
+                }
+            } else if (ch == '\n' || ch == '\r') {
+                // Строковый литерал не может прерываться символами \r или \n
+                return {TokenType::Invalid, input_.substr(pos_, 1)};
+            }
+        }
+        // Буфер закончился до того, как встретили закрывающую кавычку
+        return {TokenType::Invalid, {}};
+    }
+
+    bool Unescape(std::string_view raw, std::string &out) {
+        out.clear();
+        out.reserve(raw.size());
+        for (size_t i = 0; i < raw.size(); ++i) {
+            const char ch = raw[i];
+            if (ch == '\n' || ch == '\r') {
+                return false;
+            }
+            if (ch != '\\') {
+                out.push_back(ch);
+                continue;
+            }
+            if (++i == raw.size()) {
+                return false;
+            }
+            // Обрабатываем одну из последовательностей: \\, \n, \t, \r, \"
+            switch (raw[i]) {
+                case 'n':
+                    out.push_back('\n');
+                    break;
+                case 't':
+                    out.push_back('\t');
+                    break;
+                case 'r':
+                    out.push_back('\r');
+                    break;
+                case '"':
+                    out.push_back('"');
+                    break;
+                case '\\':
+                    out.push_back('\\');
+                    break;
+                default:
+                    // Встретили неизвестную escape-последовательность
+                    return false;
+            }
+        }
+        return true;
+    }
+
+} //namespace parser
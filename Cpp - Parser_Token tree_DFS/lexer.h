@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace parser {
+
+    // Тип лексемы входного формата
+    enum class TokenType {
+        Name,       // имя узла (или ключевое слово null в позиции значения)
+        Assign,     // '='
+        ListBegin,  // '{'
+        ListEnd,    // '}'
+        Separator,  // ',' между узлами списка
+        String,     // значение в кавычках, уже раскодированное
+        End,        // конец входных данных
+        Invalid     // недопустимый символ
+    };
+
+    struct Token {
+        TokenType type = TokenType::End;
+        std::string_view text;
+    };
+
+    // Лексический анализатор поверх буфера в памяти (строка, mmap и т.п.).
+    // Буфер принадлежит вызывающему и должен жить дольше лексера.
+    // Имена и строки без escape-последовательностей возвращаются как string_view в исходный буфер,
+    // строки с escape раскодируются во внутренний буфер и действительны до следующего вызова Next()
+    class Lexer {
+    public:
+        explicit Lexer(std::string_view input);
+
+        // лексер, начинающий разбор с заданного смещения в буфере
+        Lexer(std::string_view input, size_t pos);
+
+        Token Next();
+
+        // смещение в байтах от начала буфера до следующей непрочитанной лексемы
+        size_t Position() const;
+
+    private:
+        void SkipSpaces();
+
+        Token ReadName();
+
+        Token ReadString();
+
+        std::string_view input_;
+        size_t pos_ = 0;
+        std::string unescaped_;
+    };
+
+    // Раскодирует escape-последовательности строки без кавычек в out.
+    // false - неизвестная последовательность или перевод строки внутри значения
+    bool Unescape(std::string_view raw, std::string &out);
+
+    // Символы, допустимые в имени узла
+    inline bool IsNameStart(char c) {
+        return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    inline bool IsNameChar(char c) {
+        return IsNameStart(c) || (c >= '0' && c <= '9');
+    }
+
+    // Пробельные символы между лексемами (как у operator>> для char)
+    inline bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+} //namespace parser
@@ -1,9 +1,31 @@
 #include "parser.h"
+#include "batch.h"
+#include "event_parser.h"
+#include "document_generator.h"
+#include "document_index.h"
+#include "lazy_document.h"
+#include "incremental.h"
+#include "flat_document.h"
+#include "mapped_file.h"
+#include "merkle.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "structural_index.h"
+#include "thread_pool.h"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <filesystem>
+#include <memory_resource>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <random>
+#include <system_error>
+#include <tuple>
 
 using namespace parser;
 using namespace std::literals;
@@ -69,6 +91,18 @@ void TestArray() {
            == arr_node);
 }
 
+void TestSetters() {
+    // цепочка сеттеров на временном узле перемещает его целиком
+    Node moved = Node{Array{Node{"1"s}.SetName("x"s).SetId(2)}}.SetName("a"s).SetId(1);
+    assert(moved.GetName() == "a"s && moved.GetId() == 1);
+    assert(moved.AsArray().at(0).GetName() == "x"s && moved.AsArray().at(0).GetId() == 2);
+
+    // для именованного узла сеттеры возвращают ссылку на него же
+    Node node{"value"s};
+    assert(&node.SetName("b"s).SetId(3) == &node);
+    assert(node.GetName() == "b"s && node.GetId() == 3);
+}
+
 void MustFailToLoad(const std::string &s) {
     try {
         LoadParseFile(s);
@@ -156,36 +190,1147 @@ void TestCase() {
     assert(s.str() == t_out);
 }
 
+void TestLoadBuffer() {
+    // буфер вызывающего: результат совпадает с разбором из потока
+    const std::string text = "test = {x=\"1\" y=\"0\" z=\"0\"}"s;
+    assert(parser::Load(std::string_view(text)).GetRoot() == LoadParseFile(text).GetRoot());
+
+    // escape-последовательности раскодируются, строки без них читаются из буфера как есть
+    const Document doc = parser::Load("a = {b = \"x\\ty\\\"z\" c = \"plain\"}"sv);
+    const Node &root = doc.GetRoot();
+    assert(root.AsArray().at(0).AsString() == "x\ty\"z"s);
+    assert(root.AsArray().at(1).AsString() == "plain"s);
+    assert(root.AsArray().at(1).GetName() == "c"s);
+
+    // файл, отображенный в память
+    const auto path = std::filesystem::temp_directory_path() / "parser_test_input.txt";
+    {
+        std::ofstream out(path);
+        out << text;
+    }
+    assert(parser::LoadFile(path.string()).GetRoot() == LoadParseFile(text).GetRoot());
+    std::filesystem::remove(path);
+
+    try {
+        parser::LoadFile((path / "missing").string());
+        assert(false);
+    } catch (const std::system_error &) {
+        // ok
+    }
+}
+
+void TestNames() {
+    SymbolTable table;
+    assert(table.Intern("point"sv) == 0 && table.Intern("x"sv) == 1 && table.Intern("point"sv) == 0);
+    assert(table.Find("x"sv) == 1 && table.Find("y"sv) == SymbolTable::kNoSymbol);
+    const SymbolTable copy = table;
+    assert(copy.Size() == 2 && copy.Get(1) == "x"s && copy.Find("point"sv) == 0);
+
+    // одинаковые имена узлов - одна строка таблицы документа, общая таблица не растет от разбора
+    const size_t interned = InternedNameCount();
+    const Document doc = LoadParseFile("a = { point = { x = \"1\" } point = { x = \"2\" } }"s);
+    const Array &points = doc.GetRoot().AsArray();
+    assert(points[0].HasSameName(points[1]) && &points[0].GetName() == &points[1].GetName());
+    assert(!points[0].HasSameName(doc.GetRoot()));
+    assert(points[0].HasSameName(Load("point = null"sv).GetRoot()));
+    assert(Node{}.GetName().empty() && Node{}.HasSameName(Node{nullptr}.SetName(""sv)));
+    assert(&Node{nullptr}.SetName("manual_name"sv).GetName() == &InternName("manual_name"sv));
+    assert(InternedNameCount() == interned + 1);
+
+    // таблицы имен живут, пока жива копия документа
+    const Document survivor = [] {
+        const Document original = Load("unique_root = { unique_child = null }"sv);
+        return Document(original);
+    }();
+    assert(survivor.GetRoot().GetName() == "unique_root"s && survivor.GetRoot().AsArray()[0].GetName() == "unique_child"s);
+    assert(InternedNameCount() == interned + 1);
+
+    // в плоском документе каждое имя хранится в пуле один раз
+    std::string text = "root = {"s;
+    for (int i = 0; i < 1000; ++i) {
+        text += " point = { x = \"1\" y = \"2\" }"s;
+    }
+    text += " }"s;
+    const FlatDocument flat = LoadFlat(text);
+    assert(flat.View().SymbolCount() == 4);
+    assert(flat.GetNode(2).name == flat.GetNode(5).name && flat.GetNode(3).name != flat.GetNode(4).name);
+    assert(flat.View().GetPool().size() == "rootpointxy"s.size() + 2000);
+}
+
+void TestFlatDocument() {
+    const std::string text = R"(shape = { type = "tetra\"hedron" vertices = { point = { x = "1" y = null } } color = "red" })";
+    const FlatDocument flat = LoadFlat(text);
+    assert(flat.Size() == 7);
+
+    // id совпадают с нумерацией парсера, связи - с деревом
+    const FlatNode &vertices = flat.GetNode(3);
+    assert(flat.GetName(3) == "vertices"sv);
+    assert(vertices.kind == NodeKind::List && vertices.parent_id == 1);
+    assert(vertices.first_child == 4 && vertices.next_sibling == 7);
+    assert(flat.GetNode(4).first_child == 5 && flat.GetNode(5).next_sibling == 6);
+    assert(flat.GetValue(2) == "tetra\"hedron"sv);
+    assert(flat.GetNode(6).kind == NodeKind::Null);
+
+    // вывод таблицы совпадает с выводом дерева
+    std::ostringstream tree_out, flat_out, flatten_out;
+    parser::Print(LoadParseFile(text), tree_out);
+    parser::Print(flat, flat_out);
+    parser::Print(Flatten(LoadParseFile(text)), flatten_out);
+    assert(flat_out.str() == tree_out.str());
+    assert(flatten_out.str() == tree_out.str());
+
+    // ошибки формата те же, что и у Load
+    for (const auto &bad: {"a = {}"s, "a = {b = \"1\""s, "a = {{b = \"1\"}}"s, "a = {b = 1}"s, "1a = \"1\""s}) {
+        try {
+            LoadFlat(bad);
+            assert(false);
+        } catch (const ParsingError &) {
+            // ok
+        }
+    }
+}
+
+void TestDocumentIndex() {
+    const std::string text = R"(shape = { type = "tetrahedron" vertices = {
+                              point = { x = "1" y = "0" } point = { x = "0" y = "1" } point = { x = "0" y = "0" } }
+                              color = null })";
+    const Document doc = LoadParseFile(text);
+    const DocumentIndex index(doc);
+
+    // id -> узел и родитель
+    assert(index.FindById(1) == &doc.GetRoot());
+    assert(index.FindById(8)->GetName() == "x"s && index.FindById(8)->AsString() == "0"s);
+    assert(index.GetParentId(8) == 7 && index.GetParentId(1) == 0);
+    assert(index.FindById(0) == nullptr && index.FindById(100) == nullptr && index.GetParentId(-5) == -1);
+
+    // id списка -> потомки
+    assert(index.GetChildren(3).size() == 3 && &index.GetChildren(3)[1] == index.FindById(7));
+    assert(index.GetChildren(2).empty() && index.GetChildren(100).empty());
+
+    // пути
+    assert(index.FindByPath("shape"sv) == &doc.GetRoot());
+    assert(index.FindByPath("shape/vertices/point[1]/y"sv) == index.FindById(9));
+    assert(index.FindByPath("shape/vertices/point/x"sv) == index.FindById(5));
+    assert(index.FindByPath("shape/color"sv)->IsNull());
+    assert(index.FindByPath("shape/vertices/point[3]"sv) == nullptr);
+    assert(index.FindByPath("shape/type/x"sv) == nullptr);
+    assert(index.FindByPath("color"sv) == nullptr);
+    for (const auto bad: {""sv, "shape//type"sv, "shape/point[x]"sv, "shape/point[]"sv, "shape/[1]"sv}) {
+        try {
+            index.FindByPath(bad);
+            assert(false);
+        } catch (const std::invalid_argument &) {
+            // ok
+        }
+    }
+
+    // широкий список ищется через хеш-таблицу имен, результат тот же
+    std::string wide = "root = {"s;
+    for (int i = 0; i < 100; ++i) {
+        wide += " n"s + std::to_string(i % 10) + " = \""s + std::to_string(i) + "\""s;
+    }
+    wide += " }"s;
+    const Document wide_doc = LoadParseFile(wide);
+    const DocumentIndex wide_index(wide_doc);
+    assert(wide_index.FindByPath("root/n3[4]"sv)->AsString() == "43"s);
+    assert(wide_index.FindByPath("root/n9[9]"sv)->AsString() == "99"s);
+    assert(wide_index.FindByPath("root/n9[10]"sv) == nullptr && wide_index.FindByPath("root/n10"sv) == nullptr);
+
+    // одновременные запросы из нескольких потоков, в том числе к еще не построенной таблице имен
+    const DocumentIndex shared_index(wide_doc);
+    ParallelFor(8, 4, [&shared_index](size_t i) {
+        const std::string path = "root/n"s + std::to_string(i) + "[2]"s;
+        assert(shared_index.FindByPath(path)->AsString() == std::to_string(20 + i));
+    });
+
+    // документ, собранный вручную, с произвольными id
+    Node root{Array{Node{"a"s}.SetName("a"s).SetId(-7), Node{nullptr}.SetName("b"s).SetId(1000000)}};
+    const Document manual(std::move(root).SetName("r"s).SetId(42));
+    const DocumentIndex manual_index(manual);
+    assert(manual_index.FindById(-7)->GetName() == "a"s && manual_index.GetParentId(1000000) == 42);
+    assert(manual_index.FindByPath("r/b"sv) == manual_index.FindById(1000000));
+}
+
+std::string PrintSubtree(const Node &node, int parent_id) {
+    OutputBuffer out;
+    PrintNode(node, parent_id, out);
+    return out.Take();
+}
+
+void TestLazyDocument() {
+    const std::string text = R"(shape = { type = "tetra\"hedron {" vertices = { point = { x = "1" y = null }, point = { x = "}=" } }
+                              color = { r = "0xFF" g = null } , empty = null })";
+    const Document doc = LoadParseFile(text);
+    const DocumentIndex index(doc);
+
+    // все записи ленивого документа совпадают с узлами полного разбора
+    LazyDocument lazy(text);
+    std::vector<const LazyEntry *> stack{&lazy.GetRoot()};
+    int visited = 0;
+    while (!stack.empty()) {
+        const LazyEntry &entry = *stack.back();
+        stack.pop_back();
+        ++visited;
+        const Node *node = index.FindById(entry.id);
+        assert(node && node->GetName() == entry.name && index.GetParentId(entry.id) == entry.parent_id);
+        assert((entry.kind == NodeKind::List) == node->IsArray() && (entry.kind == NodeKind::Null) == node->IsNull());
+        assert(PrintSubtree(lazy.GetNode(entry), entry.parent_id) == PrintSubtree(*node, entry.parent_id));
+        for (const LazyEntry &child: lazy.GetChildren(entry)) {
+            stack.push_back(&child);
+        }
+    }
+    assert(visited == 12);
+
+    // обращение к одному поддереву не разбирает остальные
+    LazyDocument partial(text);
+    const LazyEntry *color = partial.FindByPath("shape/color"sv);
+    assert(color && color->id == 9 && color->parent_id == 1);
+    assert(partial.FindByPath("shape/vertices/point[1]/x"sv)->id == 8);
+    assert(partial.FindByPath("shape/vertices/point[2]"sv) == nullptr && partial.FindByPath("other"sv) == nullptr);
+    assert(partial.GetNode(*color).AsArray().size() == 2 && partial.GetNode(*color).AsArray()[0].AsString() == "0xFF"s);
+    assert(partial.GetChildren(*partial.FindByPath("shape/type"sv)).empty());
+
+    // корень-строка и корень-null
+    LazyDocument single("a = \"1\""sv);
+    assert(single.GetRoot().kind == NodeKind::String && single.GetNode(single.GetRoot()).AsString() == "1"s);
+    assert(LazyDocument("a = null"sv).GetRoot().kind == NodeKind::Null);
+
+    // ошибки в заголовке - при открытии, в потомках списка - при обращении к списку,
+    // внутри пропущенного поддерева - при разборе этого поддерева
+    for (const auto &bad: {"a = {}"s, "a = {b = \"1\""s, "a = {{b = \"1\"}}"s, "a = {b = 1}"s, "a = {b = \"1\",}"s,
+                           "a = {b = nullx}"s, "a = {1b = null}"s, "a = {b = \"1\" = null}"s}) {
+        try {
+            LazyDocument broken(bad);
+            broken.GetChildren(broken.GetRoot());
+            assert(false);
+        } catch (const ParsingError &) {
+            // ok
+        }
+    }
+    for (const auto &bad: {"1a = \"1\""s, "a = 1"s, "a"s}) {
+        try {
+            LazyDocument broken(bad);
+            assert(false);
+        } catch (const ParsingError &) {
+            // ok
+        }
+    }
+    LazyDocument nested_error("a = { b = { c = 1 } d = null }"sv);
+    assert(nested_error.GetChildren(nested_error.GetRoot()).size() == 2);
+    try {
+        nested_error.GetNode(nested_error.GetChildren(nested_error.GetRoot())[0]);
+        assert(false);
+    } catch (const ParsingError &) {
+        // ok
+    }
+}
+
+void TestSnapshot() {
+    const std::string text = R"(shape = { type = "tetra\"hedron" vertices = { point = { x = "1" y = null } } color = "red" })";
+    const FlatDocument flat = LoadFlat(text);
+
+    // поддерево списка занимает непрерывный диапазон id
+    assert(flat.GetNode(1).last_descendant == 7);
+    assert(flat.GetNode(3).last_descendant == 6 && flat.GetNode(4).last_descendant == 6);
+    assert(flat.GetNode(2).last_descendant == 2);
+    assert(Flatten(LoadParseFile(text)).GetNode(3).last_descendant == 6);
+
+    std::ostringstream snapshot_out;
+    WriteSnapshot(LoadParseFile(text), snapshot_out);
+    const std::string data = snapshot_out.str();
+    assert(IsSnapshot(data) && !IsSnapshot(text));
+
+    // снимок читается без копирования и выводится так же, как исходный документ
+    const FlatView view = ReadSnapshot(data);
+    assert(view.Size() == 7);
+    assert(view.GetName(3) == "vertices"sv && view.GetValue(2) == "tetra\"hedron"sv);
+    assert(view.GetPool().data() >= data.data() && view.GetPool().data() < data.data() + data.size());
+    std::ostringstream tree_out, snapshot_print;
+    parser::Print(LoadParseFile(text), tree_out);
+    {
+        OutputBuffer buffer(snapshot_print);
+        parser::Print(view, buffer);
+    }
+    assert(snapshot_print.str() == tree_out.str());
+
+    // снимок в файле отображается в память
+    const auto path = std::filesystem::temp_directory_path() / "parser_test_snapshot.bin";
+    {
+        std::ofstream file(path, std::ios::binary);
+        WriteSnapshot(flat.View(), file);
+    }
+    {
+        const Snapshot snapshot(path.string());
+        std::ostringstream out;
+        {
+            OutputBuffer buffer(out);
+            parser::Print(snapshot.View(), buffer);
+        }
+        assert(out.str() == tree_out.str());
+    }
+    std::filesystem::remove(path);
+
+    // поврежденный заголовок, другая версия и обрезанный снимок не принимаются
+    std::string wrong_version = data;
+    wrong_version[8] = static_cast<char>(kSnapshotVersion + 1);
+    for (const auto &bad: {"PRSNAP"s, wrong_version, data.substr(0, data.size() - 1), text}) {
+        try {
+            ReadSnapshot(bad);
+            assert(false);
+        } catch (const ParsingError &) {
+            // ok
+        }
+    }
+
+    // поврежденные связи узлов: сосед - сам узел (вывод зациклился бы), ребенок вне поддерева,
+    // родитель после узла или вне таблицы (на узел не ведет ни одна ссылка), символ имени вне таблицы
+    SnapshotHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    const auto corrupt = [&](uint32_t id, auto change, std::string bad) {
+        const size_t at = header.nodes_offset + (id - 1) * sizeof(FlatNode);
+        FlatNode node;
+        bad.copy(reinterpret_cast<char *>(&node), sizeof(node), at);
+        change(node);
+        bad.replace(at, sizeof(node), reinterpret_cast<const char *>(&node), sizeof(node));
+        return bad;
+    };
+    for (const auto &bad: {corrupt(2, [](FlatNode &node) { node.next_sibling = 2; }, data),
+                           corrupt(4, [](FlatNode &node) { node.first_child = 7; }, data),
+                           corrupt(3, [](FlatNode &node) { node.parent_id = 5; }, data),
+                           corrupt(3, [](FlatNode &node) { node.parent_id = UINT32_MAX; },
+                                   corrupt(2, [](FlatNode &node) { node.next_sibling = 0; }, data)),
+                           corrupt(5, [](FlatNode &node) { node.name = 100; }, data)}) {
+        try {
+            ReadSnapshot(bad);
+            assert(false);
+        } catch (const ParsingError &) {
+            // ok
+        }
+    }
+}
+
+void TestStreaming() {
+    const std::string text = R"(shape = { type = "tetra\"hedron" vertices = { point = { x = "1" y = null } point = { x = "2" } }
+                              color = { r = "0xFF" } })";
+
+    // события приходят в порядке обхода, имена потомков списка доступны при его открытии
+    class Recorder : public ParseHandler {
+    public:
+        std::ostringstream log;
+
+        void OnNodeBegin(int id, int parent_id, std::string_view name) override {
+            log << '<' << id << ':' << parent_id << ':' << name;
+        }
+
+        void OnValue([[maybe_unused]] int id, std::string_view value) override {
+            log << '=' << value;
+        }
+
+        void OnNull([[maybe_unused]] int id) override {
+            log << "=null"sv;
+        }
+
+        void OnListBegin([[maybe_unused]] int id, const ListPreview &children) override {
+            log << '{';
+            children.ForEachChildName([this](std::string_view name) { log << name << ';'; });
+        }
+
+        void OnListEnd(int id) override {
+            log << '}' << id;
+        }
+    } recorder;
+    Parse("a = { b = { c = \"1\" } d = null }"sv, recorder);
+    assert(recorder.log.str() == "<1:0:a{b;d;<2:1:b{c;<3:2:c=1}2<4:1:d=null}1"s);
+
+    // потоковый вывод совпадает с выводом построенного дерева
+    std::ostringstream tree_out, stream_out;
+    parser::Print(LoadParseFile(text), tree_out);
+    ConvertStreaming(text, stream_out);
+    assert(stream_out.str() == tree_out.str());
+
+    try {
+        std::ostringstream out;
+        ConvertStreaming("a = { b = \"1\" c = }"sv, out);
+        assert(false);
+    } catch (const ParsingError &) {
+        // ok
+    }
+}
+
+void TestOutputBuffer() {
+    // экранирование по таблице: \" \r \n \\ заменяются, табуляция выводится как есть
+    {
+        std::ostringstream out;
+        {
+            OutputBuffer buffer(out);
+            buffer.WriteEscaped("a\"b\rc\nd\\e\tf"sv);
+            buffer.WriteIndent(300);
+            buffer.WriteInt(-42);
+            buffer.Put(',');
+            buffer.WriteInt(1234567890123);
+            // до сброса в поток ничего не попадает
+            assert(out.str().empty());
+        }
+        assert(out.str() == "a\\\"b\\rc\\nd\\\\e\tf"s + std::string(300, ' ') + "-42,1234567890123"s);
+    }
+
+    // буфер без потока накапливает текст
+    OutputBuffer detached;
+    WriteNodePrefix(detached, 4, 7, 3, "name"sv);
+    detached.Write("null\n"sv);
+    assert(detached.Take() == "    7,3,name,null\n"s);
+
+    // вывод не зависит от емкости буфера: маленький буфер сбрасывается много раз
+    const std::string text = R"(shape = { type = "tetra\"hedron\\" vertices = { point = { x = "1\n2" y = null } point = { x = "	" } }
+                              color = { r = "0xFF" } })";
+    const Document doc = LoadParseFile(text);
+    std::ostringstream expected;
+    parser::Print(doc, expected);
+    assert(expected.str() == "1,0,shape,{type vertices color}\n"
+                             "  2,1,type,tetra\\\"hedron\\\\\n"
+                             "  3,1,vertices,{point point}\n"
+                             "    4,3,point,{x y}\n"
+                             "      5,4,x,1\\n2\n"
+                             "      6,4,y,null\n"
+                             "    7,3,point,{x}\n"
+                             "      8,7,x,\t\n"
+                             "  9,1,color,{r}\n"
+                             "    10,9,r,0xFF\n"s);
+    for (size_t capacity: {size_t{1}, size_t{7}, size_t{64}}) {
+        std::ostringstream tree_out, flat_out;
+        {
+            OutputBuffer tree_buffer(tree_out, capacity);
+            OutputBuffer flat_buffer(flat_out, capacity);
+            parser::Print(doc, tree_buffer);
+            parser::Print(Flatten(doc), flat_buffer);
+        }
+        assert(tree_out.str() == expected.str());
+        assert(flat_out.str() == expected.str());
+    }
+}
+
+std::string MakeDeepDocument(int depth) {
+    std::string text;
+    for (int i = 0; i < depth; ++i) {
+        text += "n = { "s;
+    }
+    text += "leaf = \"v\""s;
+    text += std::string(depth, '}');
+    return text;
+}
+
+void TestParallelPrint() {
+    const std::string text = R"(shape = {
+        type = "tetra\"hedron{"
+        vertices = { point = { x = "1" y = "0" z = "0" } point = { x = "0" y = "1" z = "}" } , p = null }
+        color = { r = "0xFF" g = "0x00" b = "0x80" alpha = "0x80" }
+        empty = null, last = { deep = { deeper = { deepest = "=" } } }
+    })";
+    const Document doc = LoadParseFile(text);
+    const FlatDocument flat = LoadFlat(text);
+    std::ostringstream expected;
+    parser::Print(doc, expected);
+
+    // группы от одного узла: граница перед каждым потомком корня
+    for (size_t threads: {1, 2, 4}) {
+        for (size_t chunk: {size_t{1}, size_t{3}, size_t{8}, size_t{1000}}) {
+            ParallelOptions options;
+            options.threads = threads;
+            options.min_chunk_nodes = chunk;
+            std::ostringstream tree_out, flat_out;
+            PrintParallel(doc, tree_out, options);
+            PrintParallel(flat.View(), flat_out, options);
+            assert(tree_out.str() == expected.str());
+            assert(flat_out.str() == expected.str());
+        }
+    }
+
+    // отступ потомков берется из PrintContext
+    std::ostringstream indented, indented_parallel;
+    PrintNode(doc.GetRoot(), PrintContext(indented, 4, 6));
+    PrintNodeParallel(doc.GetRoot(), PrintContext(indented_parallel, 4, 6), {4, 0, 1});
+    assert(indented_parallel.str() == indented.str());
+
+    // построчный вывод через контекст: общий буфер сбрасывается в конце каждого вызова,
+    // поэтому запись напрямую в поток между вызовами не нарушает порядок
+    std::ostringstream lines;
+    const PrintContext line_ctx(lines);
+    const PrintContext child_ctx = line_ctx.Indented();
+    assert(child_ctx.buffer == line_ctx.buffer);
+    child_ctx.PrintIndent();
+    lines << "1,0,a,"sv;
+    line_ctx << doc.GetRoot().AsArray();
+    child_ctx.PrintIndent();
+    PrintValue("x\"y"sv, child_ctx, 1);
+    assert(lines.str() == "  1,0,a,{type vertices color empty last}\n  x\\\"y\n"s);
+
+    // части пишутся по порядку номеров, в том числе из вложенного вызова внутри задачи пула
+    std::vector<std::string> nested(4);
+    ParallelFor(nested.size(), 4, [&nested](size_t n) {
+        std::ostringstream out;
+        WriteParallel(out, 100, 3, [](size_t i, OutputBuffer &part) {
+            part.WriteInt(static_cast<int64_t>(i));
+            part.Put(' ');
+        });
+        nested[n] = out.str();
+    });
+    std::string numbers;
+    for (int i = 0; i < 100; ++i) {
+        numbers += std::to_string(i) + ' ';
+    }
+    for (const auto &out: nested) {
+        assert(out == numbers);
+    }
+    try {
+        std::ostringstream out;
+        WriteParallel(out, 100, 3, [](size_t i, OutputBuffer &part) {
+            if (i == 50) {
+                ThrowFormatError();
+            }
+            part.Put('.');
+        });
+        assert(false);
+    } catch (const ParsingError &) {
+        // ok
+    }
+
+    // поврежденная таблица: узел 3 закрывает корень, узел 4 ссылается на уже закрытый корень
+    std::vector<FlatNode> nodes(4);
+    nodes[0] = {0, 2, 0, 4, 0, NodeKind::List, {}};
+    nodes[1] = {1, 0, 4, 2, 0, NodeKind::Null, {}};
+    nodes[2] = {0, 0, 0, 3, 0, NodeKind::Null, {}};
+    nodes[3] = {1, 0, 0, 4, 0, NodeKind::Null, {}};
+    const PoolString symbol{0, 1};
+    const FlatView corrupt(nodes.data(), nodes.size(), &symbol, 1, "n"sv);
+    for (bool parallel: {false, true}) {
+        try {
+            std::ostringstream out;
+            if (parallel) {
+                PrintParallel(corrupt, out, {4, 0, 1});
+            } else {
+                OutputBuffer buffer(out);
+                parser::Print(corrupt, buffer);
+            }
+            assert(false);
+        } catch (const ParsingError &) {
+            // ok
+        }
+    }
+}
+
+void TestGenerator() {
+    GeneratorOptions options;
+    options.width = 3;
+    options.depth = 3;
+    options.escape_density = 0.3;
+    options.distinct_names = 2;
+
+    // одинаковый seed - одинаковый текст, число узлов 1 + 3 + 9 + 27
+    const GeneratedDocument generated = GenerateDocument(options);
+    assert(generated.nodes == 40);
+    assert(GenerateDocument(options).text == generated.text);
+    options.seed = 2;
+    assert(GenerateDocument(options).text != generated.text);
+
+    // документ разбирается, имена берутся из набора заданного размера
+    const FlatDocument flat = LoadFlat(generated.text);
+    assert(flat.Size() == generated.nodes);
+    for (uint32_t id = 2; id <= flat.Size(); ++id) {
+        assert(flat.GetName(id) == "node0"sv || flat.GetName(id) == "node1"sv);
+    }
+    assert(generated.text.find('\\') != std::string::npos);
+
+    options.depth = 0;
+    try {
+        GenerateDocument(options);
+        assert(false);
+    } catch (const std::invalid_argument &) {
+        // ok
+    }
+}
+
+void TestBatch() {
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::temp_directory_path() / "parser_test_batch";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "in");
+    const std::vector<std::pair<std::string, std::string>> inputs{
+            {"a.txt", R"(shape = { type = "tetra\"hedron" color = { r = "0xFF" } })"},
+            {"b.txt", "broken = {"},
+            {"c.txt", "value = null"}};
+    for (const auto &[name, text]: inputs) {
+        std::ofstream(dir / "in" / name) << text;
+    }
+
+    // каталог: файлы по алфавиту, ошибка в одном файле не мешает остальным
+    const std::vector<BatchJob> jobs = ListBatchJobs((dir / "in").string(), (dir / "out").string());
+    assert(jobs.size() == 3 && jobs[1].output == (dir / "out" / "b.txt").string());
+    fs::create_directories(dir / "out");
+    const BatchReport report = ConvertBatch(jobs, 2);
+    assert(report.converted == 2 && report.failures.size() == 1);
+    assert(report.failures[0].input == jobs[1].input && report.failures[0].error == "Неверный формат данных"s);
+    assert(!fs::exists(dir / "out" / "b.txt") && !fs::exists(jobs[0].output + ".part"s));
+    for (const size_t i: {0, 2}) {
+        std::ifstream file(jobs[i].output);
+        const std::string actual{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        assert(actual == Print(LoadParseFile(inputs[i].second).GetRoot()));
+    }
+
+    // манифест: имя выходного файла после табуляции, отсутствующий входной файл - ошибка в отчете
+    std::ofstream(dir / "manifest") << (dir / "in" / "a.txt").string() << "\trenamed.txt\n\n"
+                                    << (dir / "in" / "missing.txt").string() << "\n";
+    const std::vector<BatchJob> listed = ListBatchJobs((dir / "manifest").string(), (dir / "out").string());
+    assert(listed.size() == 2 && listed[0].output == (dir / "out" / "renamed.txt").string());
+    const BatchReport manifest_report = ConvertBatch(listed, 4);
+    assert(manifest_report.converted == 1 && manifest_report.failures.size() == 1);
+    assert(manifest_report.failures[0].input == listed[1].input);
+
+    // ошибка записи видна в отчете, а не теряется в деструкторе потока
+    if (fs::exists("/dev/full")) {
+        const BatchReport full = ConvertBatch({{jobs[0].input, "/dev/full"s}}, 1);
+        assert(full.converted == 0 && full.failures.size() == 1 && full.failures[0].error == "cannot write /dev/full"s);
+    }
+    // вывод в каталог, которого нет: ни выходного, ни временного файла
+    const BatchReport missing_dir = ConvertBatch({{jobs[0].input, (dir / "no" / "a.txt").string()}}, 1);
+    assert(missing_dir.converted == 0 && !fs::exists(dir / "no"));
+    fs::remove_all(dir);
+}
+
+void TestStats() {
+    const std::string text = R"(shape = { type = "tetrahedron" vertices = { point = { x = "1" y = null } } })";
+
+    ParseStats stats;
+    {
+        const StatsScope scope;
+        std::ostringstream out;
+        parser::Print(parser::Load(text), out);
+        // вложенная область перехватывает сбор, внешняя его не видит
+        {
+            const StatsScope inner;
+            parser::Load(text);
+            assert(inner.Get().nodes == (kStatsEnabled ? 6 : 0));
+        }
+        stats = scope.Get();
+    }
+    if (!kStatsEnabled) {
+        // без PARSER_STATS сбор не компилируется
+        assert(stats.nodes == 0 && stats.bytes_scanned == 0 && stats.emit_ns == 0);
+        return;
+    }
+    assert(stats.nodes == 6 && stats.strings == 2 && stats.max_depth == 3);
+    assert(stats.bytes_scanned == text.size());
+    assert(stats.allocations > 0 && stats.allocated_bytes > 0);
+    assert(stats.build_ns > 0 && stats.emit_ns > 0);
+
+    // потоки пула пишут в счетчики вызывающего
+    const StatsScope parallel;
+    ParallelFor(4, 4, [&text](size_t) { parser::Load(text); });
+    assert(parallel.Get().nodes == 24);
+
+    std::ostringstream json;
+    WriteStatsJson(stats, json);
+    assert(json.str().find("\"nodes\":6,\"strings\":2,"s) != std::string::npos);
+}
+
+void TestDeepNesting() {
+    // глубина вложенности, на которой рекурсивный разбор переполнял стек
+    const int depth = 200000;
+    const std::string text = MakeDeepDocument(depth);
+
+    const Document doc = parser::Load(text);
+    const Node *node = &doc.GetRoot();
+    for (int i = 0; i < depth; ++i) {
+        node = &node->AsArray().at(0);
+    }
+    assert(node->GetName() == "leaf"s && node->GetId() == depth + 1);
+
+    // недостроенное глубокое дерево при ошибке формата тоже уничтожается без переполнения стека
+    MustFailToLoad(text.substr(0, text.size() - 1));
+
+    // размер вывода растет с квадратом глубины (отступы), поэтому вывод проверяется на меньшей глубине:
+    // вывод дерева совпадает с последовательным выводом плоской таблицы
+    const std::string shallower = MakeDeepDocument(3000);
+    std::ostringstream tree_out, flat_out;
+    parser::Print(parser::Load(shallower), tree_out);
+    parser::Print(LoadFlat(shallower), flat_out);
+    assert(tree_out.str() == flat_out.str());
+}
+
+std::string PrintAll(const Document &doc) {
+    std::ostringstream out;
+    parser::Print(doc, out);
+    return out.str();
+}
+
+// Ресурс памяти, считающий запросы к вышестоящему ресурсу
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocations = 0;
+
+private:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+};
+
+void TestArena() {
+    GeneratorOptions options;
+    options.width = 6;
+    const std::string text = GenerateDocument(options).text;
+
+    // арена берет память у ресурса по умолчанию крупными блоками, а не на каждый узел и строку
+    CountingResource counting;
+    std::pmr::memory_resource *previous = std::pmr::set_default_resource(&counting);
+    std::optional<Document> doc = parser::Load(text);
+    std::pmr::set_default_resource(previous);
+    assert(Flatten(*doc).Size() > 1000 && counting.allocations < 16);
+
+    // узлы в куче и в арене дают одинаковые документы
+    IdAllocator ids;
+    const Document heap = parser::Load(text, ids, std::pmr::new_delete_resource());
+    assert(*doc == heap && PrintAll(*doc) == PrintAll(heap));
+
+    // копия и перемещенный документ не зависят от арены оригинала
+    const Document copy = *doc;
+    const Document moved = std::move(*doc);
+    assert(doc->GetRoot().IsNull());
+    doc.reset();
+    assert(copy == heap && moved == heap);
+
+    // параллельный разбор: по арене на часть
+    assert(LoadParallel(text, {4, 256}) == heap);
+}
+
+// Документ после правок совпадает с разбором итогового текста с нуля: дерево, id и вывод по строкам
+void CheckIncremental(const IncrementalDocument &doc) {
+    const Document expected = parser::Load(doc.GetText());
+    const std::string expected_out = PrintAll(expected);
+    assert(PrintAll(doc.GetDocument()) == expected_out);
+    OutputBuffer lines;
+    doc.PrintLines(1, static_cast<int>(Flatten(expected).Size()), lines);
+    assert(lines.Take() == expected_out);
+}
+
+void TestMerkle() {
+    const std::string text = R"(shape = {
+        type = "tetrahedron"
+        vertices = { point = { x = "1" y = "0" } point = { x = "0" y = "1" } }
+        color = { r = "0xFF" g = "0x00" }
+    })";
+    const Document before = LoadParseFile(text);
+
+    // равенство по значениям: имена не учитываются, хеш запоминается и переживает копирование
+    assert(before == LoadParseFile(text));
+    assert(before == LoadParseFile(R"(s = { t = "tetrahedron" v = { p = { x = "1" y = "0" } p = { x = "0" y = "1" } }
+        c = { r = "0xFF" g = "0x00" } })"));
+    assert(before != LoadParseFile(R"(shape = { type = "cube" })"));
+    const Document copy = before;
+    assert(copy.GetHash() == before.GetHash() && copy == before);
+    assert(HashValues(before.GetRoot()) == before.GetHash());
+
+    // одинаковые документы - пустой diff, у дерева хешей по записи на узел
+    const MerkleTree tree(before);
+    assert(tree.Size() == 12 && tree.GetEntry(0).size == 12 && tree.GetEntry(2).size == 7);
+    assert(tree.GetRootHash() == MerkleTree(LoadParseFile(text)).GetRootHash());
+    assert(Diff(before, LoadParseFile(text)).Empty());
+
+    // правки: значение (x второй точки), новый узел в начале, удаленный color/g, переименованный type
+    const Document after = LoadParseFile(R"(shape = {
+        kind = "tetrahedron"
+        vertices = { point = { z = null x = "1" y = "0" } point = { x = "2" y = "1" } }
+        color = { r = "0xFF" }
+    })");
+    const DocumentDiff diff = Diff(before, after);
+    assert((diff.changed == std::vector<std::pair<int, int>>{{2, 2}, {8, 9}}));
+    assert((diff.added == std::vector<int>{5}));
+    assert((diff.removed == std::vector<int>{12}));
+
+    // перестановка одинаковых поддеревьев не считается изменением, смена вида узла - изменение с потомками
+    const DocumentDiff swapped = Diff(LoadParseFile(R"(a = { b = { c = "1" } d = "2" e = "3" })"),
+                                      LoadParseFile(R"(a = { d = "2" b = { c = "1" } e = { f = null } })"));
+    assert((swapped.changed == std::vector<std::pair<int, int>>{{5, 5}}));
+    assert((swapped.added == std::vector<int>{6}) && swapped.removed.empty());
+
+    // правка через IncrementalDocument сбрасывает запомненный хеш
+    IncrementalDocument incremental(text);
+    const uint64_t hash = incremental.GetDocument().GetHash();
+    const size_t pos = text.find("0xFF"sv);
+    incremental.ApplyEdit(pos, pos + 4, "0xEE"sv);
+    assert(incremental.GetDocument().GetHash() != hash);
+    assert(incremental.GetDocument() == LoadParseFile(incremental.GetText().data()));
+}
+
+void TestIncremental() {
+    const std::string text = R"(shape = { type = "tetrahedron" vertices = {
+    point = { x = "1" y = "0" } point = { x = "0" y = "1" } }
+    color = { r = "0xFF", g = null } })";
+    IncrementalDocument doc(text);
+    CheckIncremental(doc);
+
+    // замена значения: меняется одна строка, нумерация прежняя
+    const size_t value = doc.GetText().find("\"0xFF\"");
+    EditResult result = doc.ApplyEdit(value + 1, value + 5, "0x10"sv);
+    assert(result.first_line == 11 && result.removed_lines == 1 && result.added_lines == 1);
+    assert(result.list_line == 10 && !result.Renumbered());
+    CheckIncremental(doc);
+
+    // значения другой длины сдвигают границы следующих узлов, по ним находятся следующие правки
+    for (const std::string_view x: {"10"sv, "100"sv, "1"sv}) {
+        const size_t pos = doc.GetText().find("x = \"") + 5;
+        result = doc.ApplyEdit(pos, doc.GetText().find('"', pos), x);
+        assert(result.first_line == 5 && !result.Renumbered());
+        CheckIncremental(doc);
+    }
+
+    // новый узел во вложенном списке: заново разбирается и сосед, которого касается правка,
+    // следующие id сдвигаются
+    const size_t point = doc.GetText().find("y = \"1\"");
+    result = doc.ApplyEdit(point, point, "z = { w = null } "sv);
+    assert(result.first_line == 9 && result.removed_lines == 1 && result.added_lines == 3);
+    assert(result.list_line == 7 && result.Renumbered());
+    CheckIncremental(doc);
+    assert(parser::DocumentIndex(doc.GetDocument()).FindByPath("shape/color/g"sv)->GetId() == 14);
+
+    // удаление узла вместе с запятой, переименование, правка в промежутке между узлами
+    const size_t g = doc.GetText().find(", g = null");
+    doc.ApplyEdit(g, g + 10, ""sv);
+    CheckIncremental(doc);
+    const size_t type = doc.GetText().find("type");
+    doc.ApplyEdit(type, type + 4, "kind"sv);
+    CheckIncremental(doc);
+    const size_t gap = doc.GetText().find("} }");
+    doc.ApplyEdit(gap + 1, gap + 1, " extra = \"e\" "sv);
+    CheckIncremental(doc);
+
+    // правка заголовка корня - полный разбор
+    result = doc.ApplyEdit(0, 5, "figure"sv);
+    assert(result.list_line == 0 && result.first_line == 1);
+    CheckIncremental(doc);
+
+    // ошибка разбора не меняет документ
+    const std::string before(doc.GetText());
+    for (const auto &[from, to, replacement]: {std::tuple{size_t{20}, size_t{20}, "\""sv},
+                                               std::tuple{size_t{0}, doc.GetText().size(), "a = {}"sv}}) {
+        try {
+            doc.ApplyEdit(from, to, replacement);
+            assert(false);
+        } catch (const ParsingError &) {
+            // ok
+        }
+        assert(doc.GetText() == before);
+        CheckIncremental(doc);
+    }
+
+    // Случайные правки: если итоговый текст разбирается, результат совпадает с полным разбором,
+    // иначе правка отклоняется
+    std::mt19937 random(7);
+    const std::vector<std::string_view> snippets{""sv, "a = \"1\" "sv, "b = null "sv, "c = { d = \"2\" } "sv,
+                                                 ", "sv, "{"sv, "}"sv, "\""sv, " "sv, "x"sv, "= "sv};
+    for (int i = 0; i < 3000; ++i) {
+        if (i % 30 == 0) {
+            // серии правок от исходного текста, чтобы документ не вырождался
+            doc = IncrementalDocument(text);
+        }
+        const std::string current(doc.GetText());
+        const size_t from = random() % (current.size() + 1);
+        const size_t to = std::min(current.size(), from + random() % 4);
+        const std::string_view replacement = snippets[random() % snippets.size()];
+        std::string edited = current;
+        edited.replace(from, to - from, replacement);
+
+        bool valid = true;
+        try {
+            parser::Load(std::string_view(edited));
+        } catch (const ParsingError &) {
+            valid = false;
+        }
+        try {
+            doc.ApplyEdit(from, to, replacement);
+            assert(valid);
+        } catch (const ParsingError &) {
+            assert(!valid);
+        }
+        assert(doc.GetText() == (valid ? edited : current));
+        CheckIncremental(doc);
+    }
+}
+
+void TestStructuralIndex() {
+    const std::string text = R"(a = { b = "x{=}\"y" c = { d = "\\" } })";
+    const StructuralIndex index = BuildStructuralIndex(text, ScanKernel::Scalar);
+    // { } = вне строк и кавычки-границы строк, экранированная кавычка и скобки внутри строки пропущены
+    const std::vector<uint64_t> expected{2, 4, 8, 10, 18, 22, 24, 28, 30, 33, 35, 37};
+    assert(index.structurals == expected);
+    assert((index.specials == std::vector<uint64_t>{15, 31, 32}));
+
+    // Случайные входы с экранированием на границах 64-байтных блоков:
+    // все реализации первого прохода дают один индекс, второй проход - те же лексемы, что Lexer
+    std::mt19937 random(42);
+    const std::string alphabet = "ab_ =={}\"\"\\\\ \n,ntx"s;
+    for (int i = 0; i < 2000; ++i) {
+        std::string input(random() % 300, ' ');
+        for (char &c: input) {
+            c = alphabet[random() % alphabet.size()];
+        }
+        const StructuralIndex scalar = BuildStructuralIndex(input, ScanKernel::Scalar);
+        for (ScanKernel kernel: {ScanKernel::Sse2, ScanKernel::Avx2}) {
+            if (IsKernelSupported(kernel)) {
+                const StructuralIndex vector = BuildStructuralIndex(input, kernel);
+                assert(vector.structurals == scalar.structurals && vector.specials == scalar.specials);
+            }
+        }
+
+        Lexer lexer(input);
+        IndexedLexer indexed(input);
+        for (;;) {
+            const Token expected_token = lexer.Next();
+            const Token token = indexed.Next();
+            assert(token.type == expected_token.type);
+            if (token.type == TokenType::End || token.type == TokenType::Invalid) {
+                break;
+            }
+            assert(token.text == expected_token.text);
+        }
+    }
+}
+
+void TestParallelLoad() {
+    const std::string text = R"(shape = {
+        type = "tetra\"hedron{"
+        vertices = { point = { x = "1" y = "0" z = "0" } point = { x = "0" y = "1" z = "}" } , p = null }
+        color = { r = "0xFF" g = "0x00" b = "0x80" alpha = "0x80" }
+        empty = null, last = { deep = { deeper = { deepest = "=" } } }
+    } trailing)";
+
+    // части размером от одного байта: граница после каждого узла верхнего уровня
+    for (size_t threads: {1, 2, 4}) {
+        for (size_t chunk: {size_t{1}, size_t{16}, size_t{64}, size_t{1000}}) {
+            const Document parallel = LoadParallel(text, {threads, chunk});
+            std::ostringstream expected, actual;
+            parser::Print(LoadParseFile(text), expected);
+            parser::Print(parallel, actual);
+            assert(actual.str() == expected.str());
+        }
+    }
+
+    // документы одновременно разбираются в разных потоках, у каждого своя нумерация
+    std::vector<std::string> outputs(8);
+    ParallelFor(outputs.size(), 4, [&](size_t i) {
+        std::ostringstream out;
+        parser::Print(parser::Load(text), out);
+        outputs[i] = out.str();
+    });
+    for (const auto &out: outputs) {
+        assert(out == outputs.front());
+    }
+
+    // ошибки формата те же, что и при последовательном разборе
+    for (const auto &bad: {"a = {"s, "a = {}"s, "a = { b = \"1\" c = }"s, "a = { b = \"1\" , }"s,
+                           "a = { b = { c = \"1\" }"s, "a = { b = \"1 }"s}) {
+        try {
+            LoadParallel(bad, {4, 1});
+            assert(false);
+        } catch (const ParsingError &) {
+            // ok
+        }
+    }
+}
+
 void TestParser() {
     using namespace std::literals;
 
     TestNull();
     TestStrings();
     TestArray();
+    TestSetters();
     TestErrorHandling();
+    TestLoadBuffer();
+    TestStructuralIndex();
+    TestNames();
+    TestFlatDocument();
+    TestSnapshot();
+    TestDocumentIndex();
+    TestLazyDocument();
+    TestIncremental();
+    TestMerkle();
+    TestStreaming();
+    TestOutputBuffer();
+    TestParallelLoad();
+    TestParallelPrint();
+    TestGenerator();
+    TestBatch();
+    TestStats();
+    TestDeepNesting();
+    TestArena();
 
     TestCase();
 
     std::cout << "Test passed"s << std::endl;
 }
 
-int main(int argc, char **argv) {
+#ifdef PARSER_STATS
+// Хук аллокатора для статистики: выделения памяти засчитываются активной StatsScope
+void *operator new(size_t size) {
+    parser::CountAllocation(size);
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
 
-    //тест класса
-    TestParser();
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
 
-    if (argc != 3) {
+void operator delete[](void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+#endif
+
+// --batch источник выходной_каталог [потоки]: источник - каталог или манифест (см. ListBatchJobs).
+// Ошибки отдельных файлов выводятся в stderr, остальные файлы конвертируются.
+// С print_stats в stderr выводится строка "путь<TAB>статистика в JSON" на каждый файл
+int RunBatch(int argc, char **argv, bool print_stats) {
+    size_t threads = 0;
+    if (argc == 5) {
+        threads = std::strtoul(argv[4], nullptr, 10);
+        if (threads == 0) {
+            return -1;
+        }
+    }
+    std::vector<parser::BatchJob> jobs;
+    try {
+        std::filesystem::create_directories(argv[3]);
+        jobs = parser::ListBatchJobs(argv[2], argv[3]);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+
+    const parser::BatchReport report = parser::ConvertBatch(jobs, threads);
+    for (const auto &failure: report.failures) {
+        std::cerr << failure.input << ": "s << failure.error << '\n';
+    }
+    if (print_stats) {
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            std::cerr << jobs[i].input << '\t';
+            parser::WriteStatsJson(report.stats[i], std::cerr);
+            std::cerr << '\n';
+        }
+    }
+    std::cerr << "converted "s << report.converted << " of "s << jobs.size() << std::endl;
+    return report.failures.empty() ? 0 : 1;
+}
+
+// Конвертация одного файла
+int Convert(int argc, char **argv) {
+    // --stream: потоковая конвертация без построения документа (память - стек открытых списков и их границы)
+    // --snapshot: вместо текста записывается двоичный снимок документа. Снимок можно подать на вход
+    // вместо текста: он распознается по сигнатуре и выводится без разбора
+    const bool streaming = argc == 4 && argv[1] == "--stream"sv;
+    const bool snapshot = argc == 4 && argv[1] == "--snapshot"sv;
+    if (argc != 3 && !streaming && !snapshot) {
         return -1;
     }
+    const char *inPath = argv[argc - 2];
+    const char *outPath = argv[argc - 1];
 
-    std::ifstream inFile(argv[1]);
-    if (inFile) {
-        parser::Document doc = parser::Load(inFile);
-        std::fstream outFile(argv[2], std::ios::out);
+    try {
+        const parser::MappedFile inFile(inPath);
+        if (streaming) {
+            std::fstream outFile(outPath, std::ios::out);
+            if (outFile) {
+                parser::ConvertStreaming(inFile.Data(), outFile);
+                return 0;
+            }
+            return -1;
+        }
+        if (parser::IsSnapshot(inFile.Data())) {
+            const parser::FlatView view = parser::ReadSnapshot(inFile.Data());
+            std::fstream outFile(outPath, std::ios::out);
+            if (outFile) {
+                parser::PrintParallel(view, outFile);
+                return 0;
+            }
+            return -1;
+        }
+        // конвертация идет через плоское представление: меньше памяти на узел и последовательный вывод
+        const parser::FlatDocument doc = parser::LoadFlat(inFile.Data());
+        if (snapshot) {
+            std::fstream outFile(outPath, std::ios::out | std::ios::binary);
+            if (outFile) {
+                parser::WriteSnapshot(doc.View(), outFile);
+                return 0;
+            }
+            return -1;
+        }
+        std::fstream outFile(outPath, std::ios::out);
         if (outFile) {
-            Print(doc, outFile);
+            // поддеревья корня форматируются параллельно, вывод тот же, что у Print
+            parser::PrintParallel(doc.View(), outFile);
             return 0;
         }
+    } catch (const std::system_error &) {
+        // входной файл не удалось открыть
     }
     return -1;
-}
\ No newline at end of file
+}
+
+int main(int argc, char **argv) {
+
+    // --self-test: тесты класса (запускаются через ctest, а не при каждой конвертации)
+    if (argc == 2 && argv[1] == "--self-test"sv) {
+#ifdef NDEBUG
+        // тесты - assert, без них проверять нечего
+        std::cerr << "self-test requires a build without NDEBUG"s << std::endl;
+        return -1;
+#else
+        TestParser();
+        return 0;
+#endif
+    }
+
+    // --stats перед остальными аргументами: статистика конвертации в JSON выводится в stderr.
+    // Доступна только в сборке с PARSER_STATS
+    const bool print_stats = argc > 1 && argv[1] == "--stats"sv;
+    if (print_stats) {
+        if (!parser::kStatsEnabled) {
+            std::cerr << "statistics are disabled in this build (PARSER_STATS)"s << std::endl;
+            return -1;
+        }
+        --argc;
+        ++argv;
+    }
+    if ((argc == 4 || argc == 5) && argv[1] == "--batch"sv) {
+        return RunBatch(argc, argv, print_stats);
+    }
+
+    const parser::StatsScope stats;
+    const int result = Convert(argc, argv);
+    if (print_stats) {
+        parser::WriteStatsJson(stats.Get(), std::cerr);
+        std::cerr << std::endl;
+    }
+    return result;
+}
@@ -0,0 +1,116 @@
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace parser {
+
+#ifdef _WIN32
+
+    MappedFile::MappedFile(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        std::ostringstream content;
+        content << in.rdbuf();
+        buffer_ = std::move(content).str();
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+
+    void MappedFile::Release() {
+        buffer_.clear();
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept
+            : buffer_(std::move(other.buffer_)) {
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        other.Release();
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            buffer_ = std::move(other.buffer_);
+            data_ = buffer_.data();
+            size_ = buffer_.size();
+            other.Release();
+        }
+        return *this;
+    }
+
+#else
+
+    MappedFile::MappedFile(const std::string &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                const int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), path);
+            }
+            // файл читается последовательно от начала до конца
+            ::madvise(addr, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char *>(addr);
+        }
+        // отображение остается действительным и после закрытия дескриптора
+        ::close(fd);
+    }
+
+    void MappedFile::Release() {
+        if (data_) {
+            ::munmap(const_cast<char *>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept
+            : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            Release();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+#endif
+
+    MappedFile::~MappedFile() {
+        Release();
+    }
+
+    std::string_view MappedFile::Data() const {
+        return {data_, size_};
+    }
+
+} //namespace parser
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace parser {
+
+    // Файл, отображенный в память только для чтения.
+    // Содержимое доступно через Data() без копирования, пока жив объект
+    class MappedFile {
+    public:
+        // бросает std::system_error, если файл не удалось открыть или отобразить
+        explicit MappedFile(const std::string &path);
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        MappedFile(MappedFile &&other) noexcept;
+
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        ~MappedFile();
+
+        std::string_view Data() const;
+
+    private:
+        void Release();
+
+        const char *data_ = nullptr;
+        size_t size_ = 0;
+#ifdef _WIN32
+        // без POSIX mmap файл читается в память целиком
+        std::string buffer_;
+#endif
+    };
+
+} //namespace parser
@@ -0,0 +1,260 @@
+#include "merkle.h"
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+namespace parser {
+
+    namespace {
+
+        constexpr uint64_t kNullSeed = 0x6e756c6cULL;
+        constexpr uint64_t kStringSeed = 0x73747269ULL;
+        constexpr uint64_t kListSeed = 0x6c697374ULL;
+
+        // финальное перемешивание splitmix64
+        uint64_t Mix(uint64_t x) {
+            x ^= x >> 30;
+            x *= 0xbf58476d1ce4e5b9ULL;
+            x ^= x >> 27;
+            x *= 0x94d049bb133111ebULL;
+            x ^= x >> 31;
+            return x;
+        }
+
+        uint64_t Combine(uint64_t seed, uint64_t value) {
+            return Mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+        }
+
+        uint64_t HashString(std::string_view text) {
+            return std::hash<std::string_view>{}(text);
+        }
+
+        // Хеши поддеревьев обходом в глубину по явному стеку. enter(node) вызывается до потомков узла
+        // и возвращает его номер, leave(номер, хеш) - после. with_names - в хеш узла входит его имя
+        template<typename Enter, typename Leave>
+        uint64_t HashTree(const Node &root, bool with_names, Enter enter, Leave leave) {
+            struct Frame {
+                const Node *node;
+                size_t index;
+                size_t next;
+                uint64_t hash;
+            };
+
+            const auto finish = [with_names](const Node &node, uint64_t hash) {
+                return with_names ? Combine(HashString(node.GetName()), hash) : hash;
+            };
+
+            std::vector<Frame> stack{{&root, enter(root), 0, Mix(kListSeed)}};
+            uint64_t result = 0;
+            while (!stack.empty()) {
+                Frame &frame = stack.back();
+                const Node &node = *frame.node;
+                uint64_t hash;
+                if (node.IsArray()) {
+                    const Array &children = node.AsArray();
+                    if (frame.next < children.size()) {
+                        const Node &child = children[frame.next++];
+                        stack.push_back({&child, enter(child), 0, Mix(kListSeed)});
+                        continue;
+                    }
+                    hash = finish(node, Combine(frame.hash, children.size()));
+                } else if (node.IsString()) {
+                    hash = finish(node, Combine(kStringSeed, HashString(node.AsString())));
+                } else {
+                    hash = finish(node, Mix(kNullSeed));
+                }
+                leave(frame.index, hash);
+                stack.pop_back();
+                if (stack.empty()) {
+                    result = hash;
+                } else {
+                    stack.back().hash = Combine(stack.back().hash, hash);
+                }
+            }
+            return result;
+        }
+
+        // Потомки списка: номера записей в дереве хешей
+        std::vector<size_t> Children(const MerkleTree &tree, size_t index) {
+            std::vector<size_t> children;
+            const size_t end = index + tree.GetEntry(index).size;
+            for (size_t i = index + 1; i < end; i += tree.GetEntry(i).size) {
+                children.push_back(i);
+            }
+            return children;
+        }
+
+        // Все id поддерева
+        void CollectIds(const MerkleTree &tree, size_t index, std::vector<int> &ids) {
+            const size_t end = index + tree.GetEntry(index).size;
+            for (size_t i = index; i < end; ++i) {
+                ids.push_back(tree.GetEntry(i).node->GetId());
+            }
+        }
+
+    } // namespace
+
+    uint64_t HashValues(const Node &node) {
+        return HashTree(node, false, [](const Node &) { return size_t{0}; }, [](size_t, uint64_t) {});
+    }
+
+    bool EqualValues(const Node &lhs, const Node &rhs) {
+        std::vector<std::pair<const Node *, const Node *>> stack{{&lhs, &rhs}};
+        while (!stack.empty()) {
+            const auto [a, b] = stack.back();
+            stack.pop_back();
+            if (a->index() != b->index()) {
+                return false;
+            }
+            if (a->IsString()) {
+                if (a->AsString() != b->AsString()) {
+                    return false;
+                }
+            } else if (a->IsArray()) {
+                const Array &a_children = a->AsArray();
+                const Array &b_children = b->AsArray();
+                if (a_children.size() != b_children.size()) {
+                    return false;
+                }
+                for (size_t i = a_children.size(); i > 0; --i) {
+                    stack.emplace_back(&a_children[i - 1], &b_children[i - 1]);
+                }
+            }
+        }
+        return true;
+    }
+
+    MerkleTree::MerkleTree(const Document &doc) {
+        HashTree(doc.GetRoot(), true,
+                 [this](const Node &node) {
+                     entries_.push_back({&node, 0, 0});
+                     return entries_.size() - 1;
+                 },
+                 [this](size_t index, uint64_t hash) {
+                     entries_[index].hash = hash;
+                     entries_[index].size = static_cast<uint32_t>(entries_.size() - index);
+                 });
+    }
+
+    uint64_t MerkleTree::GetRootHash() const {
+        return entries_.front().hash;
+    }
+
+    size_t MerkleTree::Size() const {
+        return entries_.size();
+    }
+
+    const MerkleTree::Entry &MerkleTree::GetEntry(size_t index) const {
+        return entries_[index];
+    }
+
+    DocumentDiff Diff(const MerkleTree &before, const MerkleTree &after) {
+        DocumentDiff diff;
+
+        // пары сопоставленных узлов, хеши которых еще не сравнивались
+        std::vector<std::pair<size_t, size_t>> pending{{0, 0}};
+        while (!pending.empty()) {
+            const auto [i, j] = pending.back();
+            pending.pop_back();
+            const MerkleTree::Entry &a = before.GetEntry(i);
+            const MerkleTree::Entry &b = after.GetEntry(j);
+            if (a.hash == b.hash) {
+                continue;
+            }
+            const bool renamed = !a.node->HasSameName(*b.node);
+            if (a.node->index() != b.node->index() || !a.node->IsArray()) {
+                // лист или смена вида узла: узел изменен, прежние потомки удалены, новые добавлены
+                diff.changed.emplace_back(a.node->GetId(), b.node->GetId());
+                for (size_t k = i + 1; k < i + a.size; k += before.GetEntry(k).size) {
+                    CollectIds(before, k, diff.removed);
+                }
+                for (size_t k = j + 1; k < j + b.size; k += after.GetEntry(k).size) {
+                    CollectIds(after, k, diff.added);
+                }
+                continue;
+            }
+            if (renamed) {
+                diff.changed.emplace_back(a.node->GetId(), b.node->GetId());
+            }
+
+            // Сопоставление потомков: общие начало и конец с равными хешами пропускаются
+            const std::vector<size_t> old_children = Children(before, i);
+            const std::vector<size_t> new_children = Children(after, j);
+            size_t head = 0;
+            while (head < old_children.size() && head < new_children.size()
+                   && before.GetEntry(old_children[head]).hash == after.GetEntry(new_children[head]).hash) {
+                ++head;
+            }
+            size_t old_tail = old_children.size(), new_tail = new_children.size();
+            while (old_tail > head && new_tail > head
+                   && before.GetEntry(old_children[old_tail - 1]).hash
+                      == after.GetEntry(new_children[new_tail - 1]).hash) {
+                --old_tail;
+                --new_tail;
+            }
+
+            // в середине сначала одинаковые поддеревья (перестановки), затем узлы с тем же именем по порядку
+            std::unordered_map<uint64_t, std::deque<size_t>> by_hash;
+            for (size_t k = head; k < new_tail; ++k) {
+                by_hash[after.GetEntry(new_children[k]).hash].push_back(k);
+            }
+            std::vector<bool> new_matched(new_tail, false);
+            std::vector<size_t> old_unmatched;
+            for (size_t k = head; k < old_tail; ++k) {
+                const auto it = by_hash.find(before.GetEntry(old_children[k]).hash);
+                if (it != by_hash.end() && !it->second.empty()) {
+                    new_matched[it->second.front()] = true;
+                    it->second.pop_front();
+                } else {
+                    old_unmatched.push_back(k);
+                }
+            }
+            std::unordered_map<std::string_view, std::deque<size_t>> by_name;
+            for (size_t k = head; k < new_tail; ++k) {
+                if (!new_matched[k]) {
+                    by_name[after.GetEntry(new_children[k]).node->GetName()].push_back(k);
+                }
+            }
+            std::vector<size_t> old_unnamed;
+            for (size_t k: old_unmatched) {
+                const size_t old_index = old_children[k];
+                const auto it = by_name.find(before.GetEntry(old_index).node->GetName());
+                if (it != by_name.end() && !it->second.empty()) {
+                    new_matched[it->second.front()] = true;
+                    pending.emplace_back(old_index, new_children[it->second.front()]);
+                    it->second.pop_front();
+                } else {
+                    old_unnamed.push_back(old_index);
+                }
+            }
+            // оставшиеся сопоставляются по порядку (переименование), лишние удалены или добавлены
+            auto old_it = old_unnamed.begin();
+            for (size_t k = head; k < new_tail; ++k) {
+                if (new_matched[k]) {
+                    continue;
+                }
+                if (old_it != old_unnamed.end()) {
+                    pending.emplace_back(*old_it++, new_children[k]);
+                } else {
+                    CollectIds(after, new_children[k], diff.added);
+                }
+            }
+            for (; old_it != old_unnamed.end(); ++old_it) {
+                CollectIds(before, *old_it, diff.removed);
+            }
+        }
+
+        std::sort(diff.added.begin(), diff.added.end());
+        std::sort(diff.removed.begin(), diff.removed.end());
+        std::sort(diff.changed.begin(), diff.changed.end());
+        return diff;
+    }
+
+    DocumentDiff Diff(const Document &before, const Document &after) {
+        return Diff(MerkleTree(before), MerkleTree(after));
+    }
+
+} //namespace parser
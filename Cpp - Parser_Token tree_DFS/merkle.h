@@ -0,0 +1,61 @@
+#pragma once
+
+#include "parser.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace parser {
+
+    // Хеш значений поддерева: вид узлов, строки и порядок потомков, без имен и id -
+    // то же, что сравнивает operator== для узлов
+    uint64_t HashValues(const Node &node);
+
+    // Сравнение значений поддеревьев, как operator== для узлов, но без рекурсии
+    bool EqualValues(const Node &lhs, const Node &rhs);
+
+    // Дерево хешей (Merkle) документа: для каждого узла - хеш его поддерева вместе с именами.
+    // Узлы лежат в порядке обхода в глубину, поддерево узла занимает size записей начиная с него,
+    // поэтому одинаковые поддеревья пропускаются без обхода. Документ должен жить дольше дерева хешей
+    class MerkleTree {
+    public:
+        struct Entry {
+            const Node *node = nullptr;
+            uint64_t hash = 0;
+            uint32_t size = 0;
+        };
+
+        explicit MerkleTree(const Document &doc);
+
+        uint64_t GetRootHash() const;
+
+        size_t Size() const;
+
+        // запись по номеру в порядке обхода, 0 - корень
+        const Entry &GetEntry(size_t index) const;
+
+    private:
+        std::vector<Entry> entries_;
+    };
+
+    // Отличия двух версий документа. Потомки списков сопоставляются по шагам: совпадающие начало
+    // и конец списка, одинаковые поддеревья, узлы с тем же именем по порядку, остальные по порядку
+    struct DocumentDiff {
+        std::vector<int> added;                     // id в новой версии
+        std::vector<int> removed;                   // id в старой версии
+        std::vector<std::pair<int, int>> changed;   // (старый id, новый id): другое имя или значение
+
+        bool Empty() const {
+            return added.empty() && removed.empty() && changed.empty();
+        }
+    };
+
+    // Спуск идет только в поддеревья с разными хешами. Списки попадают в changed при смене имени,
+    // изменения потомков отражаются в потомках. Все id в результате по возрастанию
+    DocumentDiff Diff(const MerkleTree &before, const MerkleTree &after);
+
+    DocumentDiff Diff(const Document &before, const Document &after);
+
+} //namespace parser
@@ -0,0 +1,239 @@
+#include "output_buffer.h"
+#include "thread_pool.h"
+
+#include <array>
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace parser {
+
+    // Таблица экранирования: для спецсимвола - буква после '\', для остальных - 0
+    constexpr std::array<char, 256> MakeEscapeTable() {
+        std::array<char, 256> table{};
+        table[static_cast<unsigned char>('"')] = '"';
+        table[static_cast<unsigned char>('\r')] = 'r';
+        table[static_cast<unsigned char>('\n')] = 'n';
+        table[static_cast<unsigned char>('\\')] = '\\';
+        return table;
+    }
+
+    constexpr std::array<char, 256> kEscapeTable = MakeEscapeTable();
+
+    OutputBuffer::OutputBuffer() = default;
+
+    OutputBuffer::OutputBuffer(std::ostream &out, size_t capacity)
+            : out_(&out), capacity_(capacity) {
+        buffer_.reserve(capacity_);
+    }
+
+    OutputBuffer::~OutputBuffer() {
+        Flush();
+    }
+
+    void OutputBuffer::Reserve(size_t size) {
+        if (out_ && buffer_.size() + size > capacity_) {
+            Flush();
+        }
+    }
+
+    void OutputBuffer::Put(char c) {
+        Reserve(1);
+        buffer_.push_back(c);
+    }
+
+    void OutputBuffer::Write(std::string_view text) {
+        Reserve(text.size());
+        if (out_ && text.size() > capacity_) {
+            // крупный блок пишется напрямую, минуя буфер
+            out_->write(text.data(), static_cast<std::streamsize>(text.size()));
+            return;
+        }
+        buffer_.append(text);
+    }
+
+    void OutputBuffer::WriteInt(int64_t value) {
+        char digits[24];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        Write(std::string_view(digits, result.ptr - digits));
+    }
+
+    void OutputBuffer::WriteIndent(int width) {
+        static const std::string spaces(256, ' ');
+        for (; width > 0; width -= static_cast<int>(spaces.size())) {
+            Write(std::string_view(spaces).substr(0, std::min<size_t>(width, spaces.size())));
+        }
+    }
+
+    void OutputBuffer::WriteEscaped(std::string_view text) {
+        size_t clean_begin = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            const char code = kEscapeTable[static_cast<unsigned char>(text[i])];
+            if (code) {
+                Write(text.substr(clean_begin, i - clean_begin));
+                Put('\\');
+                Put(code);
+                clean_begin = i + 1;
+            }
+        }
+        Write(text.substr(clean_begin));
+    }
+
+    void OutputBuffer::Flush() {
+        if (out_ && !buffer_.empty()) {
+            out_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            buffer_.clear();
+        }
+    }
+
+    std::string OutputBuffer::Take() {
+        std::string result = std::move(buffer_);
+        buffer_.clear();
+        return result;
+    }
+
+    std::string_view OutputBuffer::Data() const {
+        return buffer_;
+    }
+
+    void OutputBuffer::Clear() {
+        buffer_.clear();
+    }
+
+    void WriteNodePrefix(OutputBuffer &out, int indent, int64_t id, int64_t parent_id, std::string_view name) {
+        out.WriteIndent(indent);
+        out.WriteInt(id);
+        out.Put(',');
+        out.WriteInt(parent_id);
+        out.Put(',');
+        out.Write(name);
+        out.Put(',');
+    }
+
+    void WriteParallel(std::ostream &out, size_t count, size_t threads,
+                       const std::function<void(size_t, OutputBuffer &)> &format) {
+        threads = std::max<size_t>(threads, 1);
+        // Часть i формируется в буфере i % window и может начаться, только когда записана часть i - window
+        const size_t window = std::min(2 * threads, count);
+        if (window == 0) {
+            return;
+        }
+
+        // Состояние общее с задачами пула: задача может начаться уже после возврата, тогда она видит
+        // stop и к format не обращается
+        struct State {
+            const std::function<void(size_t, OutputBuffer &)> *format;
+            size_t count;
+            size_t window;
+            std::vector<OutputBuffer> slots;
+            std::vector<char> ready;        // по буферу: часть сформирована и ждет записи
+            std::mutex mutex;
+            std::condition_variable changed;
+            size_t next = 0;                // следующая несформированная часть
+            size_t written = 0;             // записано частей
+            size_t active = 0;              // потоков внутри format
+            bool stop = false;
+            std::exception_ptr error;
+
+            explicit State(size_t window)
+                    : slots(window), ready(window, 0) {
+            }
+
+            // следующую часть можно начать: ее буфер уже записан
+            bool CanClaim() const {
+                return next < count && next < written + window;
+            }
+
+            // формирует часть, номер которой занят под замком lock
+            void Format(std::unique_lock<std::mutex> &lock) {
+                const size_t i = next++;
+                ++active;
+                lock.unlock();
+                OutputBuffer &slot = slots[i % window];
+                slot.Clear();
+                std::exception_ptr failure;
+                try {
+                    (*format)(i, slot);
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+                lock.lock();
+                --active;
+                if (failure) {
+                    if (!error) {
+                        error = failure;
+                    }
+                    stop = true;
+                } else {
+                    ready[i % window] = 1;
+                }
+                changed.notify_all();
+            }
+        };
+        auto state = std::make_shared<State>(window);
+        state->format = &format;
+        state->count = count;
+        state->window = window;
+
+        // вызывающий поток пишет и формирует сам, потоков пула - на один меньше
+        const size_t helpers = std::min(threads, count) - 1;
+        if (helpers) {
+            ThreadPool &pool = ThreadPool::Shared();
+            pool.Reserve(helpers);
+            for (size_t h = 0; h < helpers; ++h) {
+                pool.Submit([state] {
+                    State &s = *state;
+                    std::unique_lock lock(s.mutex);
+                    for (;;) {
+                        s.changed.wait(lock, [&] { return s.stop || s.next >= s.count || s.CanClaim(); });
+                        if (s.stop || s.next >= s.count) {
+                            return;
+                        }
+                        s.Format(lock);
+                    }
+                });
+            }
+        }
+
+        State &s = *state;
+        std::unique_lock lock(s.mutex);
+        try {
+            while (s.written < count && !s.stop) {
+                const size_t slot = s.written % window;
+                if (s.ready[slot]) {
+                    // запись идет без замка: буфер не переиспользуется, пока часть не записана
+                    lock.unlock();
+                    const std::string_view data = s.slots[slot].Data();
+                    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+                    lock.lock();
+                    s.ready[slot] = 0;
+                    ++s.written;
+                    s.changed.notify_all();
+                } else if (s.CanClaim()) {
+                    s.Format(lock);
+                } else {
+                    s.changed.wait(lock, [&] { return s.stop || s.ready[slot]; });
+                }
+            }
+        } catch (...) {
+            if (!lock.owns_lock()) {
+                lock.lock();
+            }
+            if (!s.error) {
+                s.error = std::current_exception();
+            }
+        }
+        // задачи пула больше не берут частей, format не должен пережить вызов
+        s.stop = true;
+        s.changed.notify_all();
+        s.changed.wait(lock, [&] { return s.active == 0; });
+        if (s.error) {
+            std::rethrow_exception(s.error);
+        }
+    }
+
+} //namespace parser
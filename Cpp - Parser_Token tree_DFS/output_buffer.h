@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace parser {
+
+    // Буфер вывода: строки выходного формата собираются в большом переиспользуемом буфере
+    // и сбрасываются в поток несколькими крупными записями.
+    // Без потока (конструктор по умолчанию) буфер просто накапливает текст, см. Take()
+    class OutputBuffer {
+    public:
+        static constexpr size_t kDefaultCapacity = size_t{1} << 20;
+
+        OutputBuffer();
+
+        explicit OutputBuffer(std::ostream &out, size_t capacity = kDefaultCapacity);
+
+        OutputBuffer(const OutputBuffer &) = delete;
+
+        OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+        ~OutputBuffer();
+
+        void Put(char c);
+
+        void Write(std::string_view text);
+
+        // целое через std::to_chars, без форматирования потока
+        void WriteInt(int64_t value);
+
+        // отступ копируется кусками из заранее подготовленной строки пробелов
+        void WriteIndent(int width);
+
+        // значение с экранированием \" \r \n \\ (табуляция выводится как есть): символы ищутся
+        // по таблице, участки без спецсимволов копируются целиком
+        void WriteEscaped(std::string_view text);
+
+        void Flush();
+
+        // накопленный текст (для буфера без потока)
+        std::string Take();
+
+        // Накопленный текст без передачи владения и его сброс с сохранением емкости:
+        // буфер без потока можно переиспользовать для многих выводов
+        std::string_view Data() const;
+
+        void Clear();
+
+    private:
+        void Reserve(size_t size);
+
+        std::ostream *out_ = nullptr;
+        size_t capacity_ = kDefaultCapacity;
+        std::string buffer_;
+    };
+
+    // Начало строки узла: отступ и "id,parent_id,name,"
+    void WriteNodePrefix(OutputBuffer &out, int indent, int64_t id, int64_t parent_id, std::string_view name);
+
+    // Параллельный вывод: части с номерами [0, count) формируются функцией format в отдельных буферах
+    // на threads потоках общего пула и пишутся в out вызывающим потоком по порядку номеров.
+    // Потоки пула заняты на весь вывод: пока готовая часть пишется, следующие уже формируются.
+    // Сформированных, но не записанных частей не больше нескольких на поток. Пока очередная часть
+    // не готова, вызывающий поток сам формирует следующие, поэтому вывод идет и при занятом пуле
+    void WriteParallel(std::ostream &out, size_t count, size_t threads,
+                       const std::function<void(size_t, OutputBuffer &)> &format);
+
+} //namespace parser
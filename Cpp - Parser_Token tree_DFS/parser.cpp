@@ -1,14 +1,22 @@
 #include "parser.h"
-#include <cctype>
+#include "event_parser.h"
+#include "structural_index.h"
+#include "thread_pool.h"
+#include "mapped_file.h"
+#include "merkle.h"
+#include "stats.h"
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <iterator>
+#include <utility>
 
 namespace parser {
 
     bool Node::IsString() const {
-        return std::holds_alternative<std::string>(*this);
+        return std::holds_alternative<std::pmr::string>(*this);
     }
 
     bool Node::IsNull() const {
@@ -16,14 +24,30 @@ namespace parser {
     }
 
     bool Node::IsArray() const {
-        return std::holds_alternative<std::vector<Node>>(*this);
+        return std::holds_alternative<Array>(*this);
     }
 
-    const std::string &Node::AsString() const {
+    Node::Node(const Node &other)
+            : NodeVariant(other), name_(other.name_ ? &InternName(*other.name_) : nullptr), id_(other.id_) {
+    }
+
+    Node &Node::operator=(const Node &other) {
+        if (this != &other) {
+            Node copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    Node::Node(std::string_view text)
+            : NodeVariant(std::pmr::string(text)) {
+    }
+
+    std::string_view Node::AsString() const {
         using namespace std::literals;
 
         if (IsString()) {
-            return std::get<std::string>(*this);
+            return std::get<std::pmr::string>(*this);
         }
         throw std::logic_error("AsString()"s);
     }
@@ -36,244 +60,478 @@ namespace parser {
         using namespace std::literals;
 
         if (IsArray()) {
-            return std::get<std::vector<Node>>(*this);
+            return std::get<Array>(*this);
         }
         throw std::logic_error("AsArray()"s);
     }
 
-    Node Node::SetName(const std::string& name) {
-        name_ = name;
+    Node &Node::SetName(std::string_view name) & {
+        name_ = name.empty() ? nullptr : &InternName(name);
+        return *this;
+    }
+
+    Node &&Node::SetName(std::string_view name) && {
+        return std::move(SetName(name));
+    }
+
+    Node &Node::SetName(std::string_view name, SymbolTable &names) & {
+        name_ = name.empty() ? nullptr : &names.Get(names.Intern(name));
         return *this;
     }
 
-    const std::string Node::GetName() const {
-        return name_;
+    Node &&Node::SetName(std::string_view name, SymbolTable &names) && {
+        return std::move(SetName(name, names));
+    }
+
+    const std::string &Node::GetName() const {
+        static const std::string empty;
+        return name_ ? *name_ : empty;
     }
 
-    Node Node::SetId(int id) {
+    bool Node::HasSameName(const Node &other) const {
+        return name_ == other.name_ || GetName() == other.GetName();
+    }
+
+    Node &Node::SetId(int id) & {
         id_ = id;
         return *this;
     }
 
+    Node &&Node::SetId(int id) && {
+        id_ = id;
+        return std::move(*this);
+    }
+
     const int Node::GetId() const {
         return id_;
     }
 
-    Document::Document(Node root)
-            : root_(move(root)) {
+    Node Node::CopyTree(const Node &source) {
+        // узел без потомков: значение копируется, имя и id переносятся как есть
+        const auto copy_shallow = [](const Node &from) {
+            Node to;
+            if (from.IsString()) {
+                to = Node(std::pmr::string(from.AsString()));
+            } else if (from.IsArray()) {
+                Array list;
+                list.reserve(from.AsArray().size());
+                to = Node(std::move(list));
+            }
+            to.name_ = from.name_;
+            to.id_ = from.id_;
+            return to;
+        };
+
+        Node root = copy_shallow(source);
+        // Списки копии заранее получают нужную емкость, поэтому указатели на добавленные узлы не меняются
+        std::vector<std::pair<const Node *, Node *>> stack{{&source, &root}};
+        while (!stack.empty()) {
+            const auto [from, to] = stack.back();
+            stack.pop_back();
+            if (!from->IsArray()) {
+                continue;
+            }
+            Array &list = std::get<Array>(*to);
+            for (const auto &e: from->AsArray()) {
+                list.push_back(copy_shallow(e));
+                stack.emplace_back(&e, &list.back());
+            }
+        }
+        return root;
+    }
+
+    std::pmr::memory_resource *DocumentArena::AddArena(size_t initial_size) {
+        arenas_.push_back(std::make_unique<std::pmr::monotonic_buffer_resource>(initial_size));
+        return arenas_.back().get();
+    }
+
+    std::pmr::memory_resource *DocumentArena::Front() {
+        if (arenas_.empty()) {
+            return AddArena(sizeof(Node));
+        }
+        return arenas_.front().get();
+    }
+
+    Document::Document(Node root, std::shared_ptr<NameTables> names)
+            : names_(move(names)), root_(new Node(move(root))) {
+    }
+
+    Document::Document(Node root, std::unique_ptr<DocumentArena> arena, std::shared_ptr<NameTables> names)
+            : arena_(move(arena)), names_(move(names)) {
+        std::pmr::polymorphic_allocator<Node> allocator(arena_->Front());
+        Node *place = allocator.allocate(1);
+        root_ = new(place) Node(move(root));
+    }
+
+    Document::Document(const Document &other)
+            // Копия не зависит от арены оригинала: pmr-контейнеры копируются в ресурс по умолчанию.
+            // Таблицы имен общие с оригиналом
+            : names_(other.names_), root_(other.root_ ? new Node(Node::CopyTree(*other.root_)) : nullptr),
+              hash_(other.hash_.load()) {
+    }
+
+    Document::Document(Document &&other) noexcept
+            : arena_(move(other.arena_)), names_(move(other.names_)), root_(std::exchange(other.root_, nullptr)),
+              hash_(other.hash_.exchange(0)) {
+    }
+
+    Document &Document::operator=(const Document &other) {
+        if (this != &other) {
+            Document copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    Document &Document::operator=(Document &&other) noexcept {
+        if (this != &other) {
+            Release();
+            arena_ = move(other.arena_);
+            names_ = move(other.names_);
+            root_ = std::exchange(other.root_, nullptr);
+            hash_ = other.hash_.exchange(0);
+        }
+        return *this;
+    }
+
+    Document::~Document() {
+        Release();
+    }
+
+    void Document::Release() {
+        // Узлы в арене не разбираются: деструкторы освободили бы в монотонной арене только
+        // собственные поля, а вся память и так уходит вместе с ней
+        if (root_ && !arena_) {
+            DestroyTree(*root_);
+            delete root_;
+        }
+        root_ = nullptr;
+        arena_.reset();
+        names_.reset();
     }
 
     const Node &Document::GetRoot() const {
-        return root_;
+        static const Node empty;
+        return root_ ? *root_ : empty;
+    }
+
+    uint64_t Document::GetHash() const {
+        uint64_t hash = hash_.load(std::memory_order_relaxed);
+        if (hash == 0) {
+            // 0 занят под признак "не вычислен"
+            hash = std::max<uint64_t>(HashValues(GetRoot()), 1);
+            hash_.store(hash, std::memory_order_relaxed);
+        }
+        return hash;
     }
 
     bool Document::operator==(const Document &rhs) const {
-        return this->GetRoot() == rhs.GetRoot();
+        return GetHash() == rhs.GetHash() && EqualValues(GetRoot(), rhs.GetRoot());
     }
 
     bool Document::operator!=(const Document &rhs) const {
-        return this->GetRoot() != rhs.GetRoot();
+        return !(*this == rhs);
     }
 
-    Node LoadNode(std::istream &input);
-
-    Node LoadString(std::istream &input) {
+    [[noreturn]] void ThrowFormatError() {
         using namespace std::literals;
+        throw ParsingError("Неверный формат данных"s);
+    }
 
-        auto it = std::istreambuf_iterator<char>(input);
-        auto end = std::istreambuf_iterator<char>();
-        std::string s;
-        while (true) {
-            if (it == end) {
-                // Поток закончился до того, как встретили закрывающую кавычку?
-                throw ParsingError("String parsing error"s);
-            }
-            const char ch = *it;
-            if (ch == '"') {
-                // Встретили закрывающую кавычку
-                ++it;
-                break;
-            } else if (ch == '\\') {
-                // Встретили начало escape-последовательности
-                ++it;
-                if (it == end) {
-                    // Поток завершился сразу после символа обратной косой черты
-                    throw ParsingError("String parsing error"s);
-                }
-                const char escaped_char = *(it);
-                // Обрабатываем одну из последовательностей: \\, \n, \t, \r, \"
-                switch (escaped_char) {
-                    case 'n':
-                        s.push_back('\n');
-                        break;
-                    case 't':
-                        s.push_back('\t');
-                        break;
-                    case 'r':
-                        s.push_back('\r');
-                        break;
-                    case '"':
-                        s.push_back('"');
-                        break;
-                    case '\\':
-                        s.push_back('\\');
-                        break;
-                    default:
-                        // Встретили неизвестную escape-последовательность
-                        throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
+    void DestroyTree(Node &node) {
+        if (!node.IsArray()) {
+            return;
+        }
+        // Поддеревья отсоединяются в явный стек, поэтому каждый список уничтожается,
+        // когда у его элементов уже нет потомков, и деструкторы не уходят в рекурсию
+        std::vector<Array> pending;
+        pending.push_back(move(std::get<Array>(node)));
+        while (!pending.empty()) {
+            Array list = move(pending.back());
+            pending.pop_back();
+            for (auto &e: list) {
+                if (e.IsArray()) {
+                    pending.push_back(move(std::get<Array>(e)));
                 }
-            } else if (ch == '\n' || ch == '\r') {
-                // Строковый литерал внутри- значения "строка" не может прерываться символами \r или \n
-                throw ParsingError("Unexpected end of line"s);
-            } else {
-                // Просто считываем очередной символ и помещаем его в результирующую строку
-                s.push_back(ch);
             }
-            ++it;
         }
-
-        return Node(move(s));
     }
 
-    std::string LoadName(std::istream &input) {
-        using namespace std::literals;
+    // Обработчик событий разбора, строящий дерево узлов. Недостроенные списки лежат
+    // в явном стеке в куче, поэтому глубина вложенности не ограничена стеком вызовов.
+    // Списки и строки выделяются из resource, имена добавляются в names
+    class TreeBuilder : public ParseHandler {
+    public:
+        TreeBuilder(std::pmr::memory_resource *resource, SymbolTable &names)
+                : resource_(resource), names_(names), top_(resource) {
+        }
+
+        TreeBuilder(const TreeBuilder &) = delete;
+
+        TreeBuilder &operator=(const TreeBuilder &) = delete;
 
-        auto it = std::istreambuf_iterator<char>(input);
-        auto end = std::istreambuf_iterator<char>();
-        std::string s;
-        while (true) {
-            if (it == end) {
-                // Поток закончился до того, как встретили =
-                throw ParsingError("Node name parsing error"s);
+        ~TreeBuilder() override {
+            // разбор прервался ошибкой - недостроенное дерево тоже разбираем без рекурсии
+            // (память в арене этим не освобождается, но деструкторы узлов не уходят в рекурсию)
+            for (auto &frame: open_) {
+                for (auto &e: frame.list) {
+                    DestroyTree(e);
+                }
             }
-            const char ch = *it;
-            if (ch == ' ' || ch == '=') {
-                // Встретили окончание имени
-                //++it;
-                break;
-            } else if (ch == '\\' || ch == '\n' || ch == '\r') {
-                // Строковый литерал внутри имени не может прерываться символами \r или \n и содержать escape
-                throw ParsingError("Node name parsing error. Unexpected end of line"s);
-            } else {
-                // Просто считываем очередной символ и помещаем его в результирующую строку
-                s.push_back(ch);
+            for (auto &e: top_) {
+                DestroyTree(e);
             }
-            ++it;
         }
 
-        return move(s);
-    }
+        void OnNodeBegin(int id, [[maybe_unused]] int parent_id, std::string_view name) override {
+            id_ = id;
+            name_ = name;
+        }
 
-    Node LoadNull(std::istream &input) {
-        using namespace std::literals;
+        void OnValue([[maybe_unused]] int id, std::string_view value) override {
+            // единственное копирование строки - в узел дерева
+            Add(Node(std::pmr::string(value, resource_)).SetName(name_, names_).SetId(id_));
+        }
 
-        std::string parsed_null;
-        if (input.peek() == 'n') {
-            for (uint8_t i = 0; i < 4; ++i) {
-                parsed_null += static_cast<char>(input.get());
-            }
-            if (!input) {
-                throw ParsingError("Failed to read null from stream"s);
-            }
-            if (parsed_null == "null"s) {
-                return Node(nullptr);
+        void OnNull([[maybe_unused]] int id) override {
+            Add(Node(nullptr).SetName(name_, names_).SetId(id_));
+        }
+
+        void OnListBegin(int id, [[maybe_unused]] const ListPreview &children) override {
+            open_.push_back({name_, id, Array(resource_)});
+        }
+
+        void OnListEnd([[maybe_unused]] int id) override {
+            Frame frame = std::move(open_.back());
+            open_.pop_back();
+            Add(Node(move(frame.list)).SetName(frame.name, names_).SetId(frame.id));
+        }
+
+        Node TakeRoot() {
+            return std::move(top_.at(0));
+        }
+
+        // узлы верхнего уровня, если разбиралась последовательность соседних узлов
+        Array TakeNodes() {
+            return std::move(top_);
+        }
+
+    private:
+        // узел строится один раз и перемещается в список родителя без копирования поддерева
+        void Add(Node &&node) {
+            if (open_.empty()) {
+                top_.emplace_back(std::move(node));
             } else {
-                throw ParsingError("Failed to read null from stream"s);
+                open_.back().list.emplace_back(std::move(node));
             }
         }
-        throw ParsingError("Null expected"s);
+
+        struct Frame {
+            std::string_view name;   // строка входного буфера
+            int id;
+            Array list;
+        };
+
+        std::pmr::memory_resource *resource_;
+        SymbolTable &names_;
+        std::vector<Frame> open_;
+        Array top_;
+        int id_ = 0;
+        std::string_view name_;
+    };
+
+    Document Load(std::string_view input) {
+        IdAllocator ids;
+        return Load(input, ids);
     }
 
-    Node LoadArray(std::istream &input) {
-        using namespace std::literals;
+    // Начальный блок арены: узлы и строки занимают порядка двух размеров входа,
+    // так что арене хватает нескольких блоков
+    size_t ArenaSize(std::string_view input) {
+        return std::max<size_t>(4096, 2 * input.size());
+    }
 
-        std::vector<Node> result;
+    Document Load(std::string_view input, IdAllocator &ids) {
+        // арена и имена объявлены раньше строителя: при ошибке разбора строитель разбирается первым
+        auto arena = std::make_unique<DocumentArena>();
+        auto names = std::make_shared<NameTables>();
+        TreeBuilder builder(arena->AddArena(ArenaSize(input)), names->Add());
+        Parse(input, builder, ids);
+        return Document(builder.TakeRoot(), move(arena), move(names));
+    }
 
-        char c;
-        for (c = '{'; input >> c && c != '}';) {
-            if (c != ',') {
-                input.putback(c);
-            }
-            result.push_back(LoadNode(input));
-        }
-        if ((c == '}' && result.empty()) || (c != '}')) {
-            throw ParsingError("List parsing error"s);
+    Document Load(std::string_view input, IdAllocator &ids, std::pmr::memory_resource *resource) {
+        auto names = std::make_shared<NameTables>();
+        TreeBuilder builder(resource, names->Add());
+        Parse(input, builder, ids);
+        return Document(builder.TakeRoot(), move(names));
+    }
+
+    Array LoadSequence(std::string_view input, IdAllocator &ids, int parent_id, SymbolTable &names,
+                       std::pmr::memory_resource *resource) {
+        if (Lexer(input).Next().type == TokenType::End) {
+            return Array(resource);
         }
-        return Node(move(result));
+        TreeBuilder builder(resource, names);
+        ParseSequence(input, builder, ids, parent_id);
+        return builder.TakeNodes();
     }
 
-    Node LoadValue(std::istream &input) {
-        using namespace std::literals;
+    // Делит тело корневого списка (от открывающей скобки до конца входа) на части по границам
+    // соседних узлов верхнего уровня, каждая не меньше target байт. Границы ищутся по структурному
+    // индексу: после закрывающей кавычки или скобки на нулевой глубине. Тело заканчивается
+    // закрывающей скобкой корня, без нее - ошибка формата
+    std::vector<std::string_view> SplitTopLevel(std::string_view body, size_t target) {
+        std::vector<std::string_view> chunks;
+        std::vector<uint64_t> structurals, specials;
+        StructuralScanner scanner(body);
+
+        size_t chunk_begin = 0;
+        int depth = 0;
+        bool in_string = false;
+        while (scanner.ScanChunk(structurals, specials)) {
+            for (uint64_t pos: structurals) {
+                const char c = body[pos];
+                bool boundary = false;
+                if (c == '"') {
+                    in_string = !in_string;
+                    boundary = !in_string && depth == 0;
+                } else if (c == '{') {
+                    ++depth;
+                } else if (c == '}') {
+                    if (depth == 0) {
+                        // закрывающая скобка корня
+                        chunks.push_back(body.substr(chunk_begin, pos - chunk_begin));
+                        return chunks;
+                    }
+                    boundary = --depth == 0;
+                }
+                if (boundary && pos + 1 - chunk_begin >= target) {
+                    chunks.push_back(body.substr(chunk_begin, pos + 1 - chunk_begin));
+                    chunk_begin = pos + 1;
+                }
+            }
+            structurals.clear();
+            specials.clear();
+        }
+        ThrowFormatError();
+    }
 
-        char c;
-        input >> c;
-
-        try {
-            if (c == '{') {
-                return LoadArray(input);
-            } else if (c == '"') {
-                return LoadString(input);
-            } else if (c == 'n') {
-                input.putback(c);
-                return LoadNull(input);
-            } else {
-                throw ParsingError("Неверный формат данных"s);
+    // Сдвигает id всех узлов поддерева на delta
+    void ShiftIds(Node &node, int delta) {
+        std::vector<Node *> stack{&node};
+        while (!stack.empty()) {
+            Node *current = stack.back();
+            stack.pop_back();
+            current->SetId(current->GetId() + delta);
+            if (current->IsArray()) {
+                for (auto &e: std::get<Array>(*current)) {
+                    stack.push_back(&e);
+                }
             }
-        } catch (...) {
-            throw ParsingError("Неверный формат данных"s);
         }
     }
 
-    Node LoadNode(std::istream &input) {
-        using namespace std::literals;
+    Document LoadParallel(std::string_view input, const ParallelOptions &options) {
+        const size_t threads = options.threads ? options.threads : DefaultThreadCount();
+        if (threads < 2 || input.size() < 2 * options.min_chunk_bytes) {
+            return Load(input);
+        }
 
-        char c;
-        input >> c;
+        // Заголовок корня "имя = {". Если корень не список - делить нечего
+        Lexer lexer(input);
+        const Token root_name = lexer.Next();
+        if (root_name.type != TokenType::Name || lexer.Next().type != TokenType::Assign
+            || lexer.Next().type != TokenType::ListBegin) {
+            return Load(input);
+        }
+        const std::string_view body = input.substr(lexer.Position());
 
-        try {
-            if (c == '_' || std::isalpha(static_cast<char>(c))) {
-                input.putback(c);
-                std::string node_name = LoadName(input);
-                input >> c;
-                if (c != '=') {
-                    throw ParsingError("Неверный формат данных"s);
-                }
-                const int id = UniqueID::GetNextID();
-                return LoadValue(input).SetName(node_name).SetId(id);
-            } else { //if (c == '{' || c == '}' || c == '"' || std::isdigit(static_cast<char>(c))) {
-                throw ParsingError("Неверный формат данных"s);
+        std::vector<std::string_view> chunks = SplitTopLevel(
+                body, std::max(options.min_chunk_bytes, body.size() / (4 * threads)));
+        // последняя часть может состоять из одних пробелов перед закрывающей скобкой
+        if (chunks.size() > 1 && Lexer(chunks.back()).Next().type == TokenType::End) {
+            chunks.pop_back();
+        }
+
+        // Каждая часть строится в своей арене и со своей таблицей имен (они заводятся до запуска потоков)
+        // и нумеруется своим счетчиком с единицы, родитель узлов верхнего уровня - корень
+        auto arena = std::make_unique<DocumentArena>();
+        auto names = std::make_shared<NameTables>();
+        std::pmr::memory_resource *root_resource = arena->AddArena(4096);
+        SymbolTable &root_names = names->Add();
+        std::vector<std::pmr::memory_resource *> resources;
+        std::vector<SymbolTable *> tables;
+        for (std::string_view chunk: chunks) {
+            resources.push_back(arena->AddArena(ArenaSize(chunk)));
+            tables.push_back(&names->Add());
+        }
+        std::vector<Array> parts(chunks.size());
+        std::vector<int> counts(chunks.size());
+        ParallelFor(chunks.size(), threads, [&](size_t i) {
+            TreeBuilder builder(resources[i], *tables[i]);
+            IdAllocator ids;
+            ParseSequence(chunks[i], builder, ids, 1);
+            parts[i] = builder.TakeNodes();
+            counts[i] = ids.Count();
+        });
+
+        // Префиксная сумма числа узлов дает сдвиг id каждой части: корень - 1, дальше части по порядку.
+        // Нумерация совпадает с последовательным обходом в глубину
+        std::vector<int> offsets(chunks.size());
+        int offset = 1;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            offsets[i] = offset;
+            offset += counts[i];
+        }
+        ParallelFor(chunks.size(), threads, [&](size_t i) {
+            for (auto &node: parts[i]) {
+                ShiftIds(node, offsets[i]);
             }
-        } catch (...) {
-            throw ParsingError("Неверный формат данных"s);
+        });
+
+        // узлы перемещаются вместе со своими аренами, копируются только заголовки верхнего уровня
+        size_t total = 0;
+        for (const auto &part: parts) {
+            total += part.size();
+        }
+        Array children(root_resource);
+        children.reserve(total);
+        for (auto &part: parts) {
+            std::move(part.begin(), part.end(), std::back_inserter(children));
         }
+        return Document(Node(std::move(children)).SetName(root_name.text, root_names).SetId(1),
+                        move(arena), move(names));
     }
 
     Document Load(std::istream &input) {
-        UniqueID::Clear();
-        return Document{LoadNode(input)};
+        // поток читается в буфер целиком блоками, а не посимвольно
+        std::ostringstream buffer;
+        buffer << input.rdbuf();
+        const std::string content = buffer.str();
+        return Load(std::string_view(content));
+    }
+
+    Document LoadFile(const std::string &path) {
+        // узлы документа владеют своими строками, поэтому отображение можно закрыть сразу после разбора
+        MappedFile file(path);
+        return Load(file.Data());
     }
 
     void PrintContext::PrintIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
-        }
+        buffer->WriteIndent(indent);
+        buffer->Flush();
     }
 
     PrintContext PrintContext::Indented() const {
-        return {out, indent_step, indent_step + indent};
+        PrintContext indented = *this;
+        indented.indent += indent_step;
+        return indented;
     }
 
     const PrintContext &operator<<(const PrintContext &ctx, const Array &arr) {
-        bool first = true;
-        ctx << '{';
-        for (const auto &e: arr) {
-            if (!first) {
-                ctx << ' ';
-            }
-            first = false;
-            ctx << e.GetName();
-        }
-        ctx << '}' << '\n';
+        PrintListSummary(arr, *ctx.buffer);
+        ctx.buffer->Flush();
         return ctx;
     }
 
@@ -286,62 +544,136 @@ namespace parser {
 
     // Перегрузка функции PrintValue для вывода значений string
     void PrintValue(const std::string& text, const PrintContext &ctx, [[maybe_unused]] int parent_id) {
-        using namespace std::literals;
-
-        std::map<char, std::string> special_chars{
-                {'\"', R"(\")"s},
-                {'\r', R"(\r)"s},
-                {'\n', R"(\n)"s},
-                {'\t', "\t"s},
-                {'\\', R"(\\)"s}
-        };
+        PrintValue(std::string_view(text), ctx, parent_id);
+    }
 
-        for (char x: text) {
-            if (special_chars.count(x)) {
-                ctx << special_chars.at(x);
-            } else {
-                ctx << x;
-            }
-        }
-        ctx << '\n';
+    void PrintValue(std::string_view text, const PrintContext &ctx, [[maybe_unused]] int parent_id) {
+        ctx.buffer->WriteEscaped(text);
+        ctx.buffer->Put('\n');
+        ctx.buffer->Flush();
     }
 
     // Перегрузка функции PrintValue для вывода значений array
     void PrintValue(const Array &arr, const PrintContext &ctx, int parent_id) {
+        PrintList(arr, parent_id, *ctx.buffer, ctx.indent, ctx.indent_step);
+        ctx.buffer->Flush();
+    }
+
+    void PrintNode(Node const &node, const PrintContext &ctx) {
+        PrintNode(node, 0, *ctx.buffer, ctx.indent, ctx.indent_step);
+        ctx.buffer->Flush();
+    }
+
+    void Print(const Document &doc, std::ostream &out) {
+        OutputBuffer buffer(out);
+        Print(doc, buffer);
+    }
+
+    void PrintNodeParallel(const Node &node, const PrintContext &ctx, const ParallelOptions &options) {
+        PARSER_STATS_PHASE(Emit);
+        const size_t threads = options.threads ? options.threads : DefaultThreadCount();
+        if (threads < 2 || !node.IsArray()) {
+            PrintNode(node, ctx);
+            return;
+        }
+
+        // Группы соседних потомков. Документ нумеруется обходом в глубину, поэтому размер поддерева
+        // потомка - разница id соседей. После правок через сеттеры оценка может быть неточной,
+        // это влияет только на размер групп
+        const Array &children = node.AsArray();
+        std::vector<size_t> bounds{0};
+        size_t nodes = 0;
+        for (size_t i = 1; i < children.size(); ++i) {
+            nodes += static_cast<size_t>(std::max(children[i].GetId() - children[i - 1].GetId(), 1));
+            if (nodes >= options.min_chunk_nodes) {
+                bounds.push_back(i);
+                nodes = 0;
+            }
+        }
+        if (bounds.size() < 2) {
+            PrintNode(node, ctx);
+            return;
+        }
+        bounds.push_back(children.size());
+
+        WriteNodePrefix(*ctx.buffer, ctx.indent, node.GetId(), 0, node.GetName());
+        PrintListSummary(children, *ctx.buffer);
+        ctx.buffer->Flush();
+        WriteParallel(ctx.out, bounds.size() - 1, threads, [&](size_t group, OutputBuffer &out) {
+            for (size_t i = bounds[group]; i < bounds[group + 1]; ++i) {
+                PrintNode(children[i], node.GetId(), out, ctx.indent + ctx.indent_step, ctx.indent_step);
+            }
+        });
+    }
 
-        ctx << arr;
+    void PrintParallel(const Document &doc, std::ostream &out, const ParallelOptions &options) {
+        PrintNodeParallel(doc.GetRoot(), PrintContext(out), options);
+    }
 
-        for (const auto &e: arr) {
-            ctx.PrintIndent();
-            ctx << e.GetId() << ',' << parent_id << ',' << e.GetName() << ',';
-            std::visit(
-                    [&ctx, &e](const auto &value) { PrintValue(value, ctx.Indented(), e.GetId()); },
-                    e.GetValue());
+    void PrintListSummary(const Array &arr, OutputBuffer &out) {
+        out.Put('{');
+        for (size_t i = 0; i < arr.size(); ++i) {
+            if (i) {
+                out.Put(' ');
+            }
+            out.Write(arr[i].GetName());
         }
+        out.Put('}');
+        out.Put('\n');
     }
 
-    void PrintNode(Node const &node, const PrintContext &ctx) {
-        using namespace std::literals;
+    // Обход поддеревьев идет по явному стеку, поэтому глубина вложенности не ограничена стеком вызовов
+    void PrintList(const Array &arr, int parent_id, OutputBuffer &out, int indent, int indent_step) {
+        // позиция вывода в списке: следующий элемент, id списка и отступ его элементов
+        struct Frame {
+            const Array *list;
+            size_t next;
+            int parent_id;
+            int indent;
+        };
+
+        PrintListSummary(arr, out);
 
-        ctx.PrintIndent();
-        ctx << node.GetId() << ",0"s << ',' << node.GetName() << ',';
-        std::visit(
-                [&ctx, &node](const auto &value) {
-                    PrintValue(value, ctx.Indented(), node.GetId());
-                },
-                node.GetValue());
+        std::vector<Frame> stack{{&arr, 0, parent_id, indent}};
+        while (!stack.empty()) {
+            Frame &frame = stack.back();
+            if (frame.next == frame.list->size()) {
+                stack.pop_back();
+                continue;
+            }
+            const Node &e = (*frame.list)[frame.next++];
+            WriteNodePrefix(out, frame.indent, e.GetId(), frame.parent_id, e.GetName());
+            if (e.IsArray()) {
+                PrintListSummary(e.AsArray(), out);
+                stack.push_back({&e.AsArray(), 0, e.GetId(), frame.indent + indent_step});
+            } else if (e.IsString()) {
+                out.WriteEscaped(e.AsString());
+                out.Put('\n');
+            } else {
+                out.Write("null\n");
+            }
+        }
     }
 
-    void Print(const Document &doc, std::ostream &out) {
-        PrintContext ctx(out, 2, 0);
-        PrintNode(doc.GetRoot(), ctx);
+    void PrintNode(const Node &node, int parent_id, OutputBuffer &out, int indent, int indent_step) {
+        WriteNodePrefix(out, indent, node.GetId(), parent_id, node.GetName());
+        if (node.IsArray()) {
+            PrintList(node.AsArray(), node.GetId(), out, indent + indent_step, indent_step);
+        } else if (node.IsString()) {
+            out.WriteEscaped(node.AsString());
+            out.Put('\n');
+        } else {
+            out.Write("null\n");
+        }
+    }
+
+    void Print(const Document &doc, OutputBuffer &out) {
+        PARSER_STATS_PHASE(Emit);
+        PrintNode(doc.GetRoot(), 0, out);
     }
 
     bool operator==(const Node &lhs, const Array &rhs) {
         return lhs.AsArray() == rhs;
     }
 
-    //инициализация счетчика стартовым значением
-    int UniqueID::nextID = 0;
-
 } //namespace parser
\ No newline at end of file
@@ -1,88 +1,209 @@
 #pragma once
 
+#include "output_buffer.h"
+#include "symbol_table.h"
+
+#include <atomic>
+#include <cstdint>
 #include <istream>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <variant>
 
 namespace parser {
 
-    //счетчик для инкремента Id
-    class UniqueID {
+    //счетчик id одного разбора: у каждого документа (и каждой части параллельного разбора) свой,
+    //поэтому разборы можно вести одновременно в разных потоках
+    class IdAllocator {
     public:
-        static int nextID;
-        static int GetNextID() {
-            return ++nextID;
+        explicit IdAllocator(int first_id = 1)
+                : next_id_(first_id), first_id_(first_id) {
+        }
+
+        int GetNextID() {
+            return next_id_++;
         }
-        static int Clear() {
-            return nextID = 0;
+
+        // сколько id уже выдано
+        int Count() const {
+            return next_id_ - first_id_;
         }
+
+    private:
+        int next_id_;
+        int first_id_;
     };
 
     class Node;
 
-    using Array = std::vector<Node>;
-    using NodeVariant = std::variant<std::nullptr_t, std::vector<Node>, std::string>;
+    // Списки и строки узлов выделяют память через std::pmr: у разобранного документа - из его арены,
+    // у узлов, построенных вручную, - из ресурса по умолчанию (общей кучи)
+    using Array = std::pmr::vector<Node>;
+    using NodeVariant = std::variant<std::nullptr_t, Array, std::pmr::string>;
 
-    class Node : public std::variant<std::nullptr_t, std::vector<Node>, std::string> {
+    class Node : public NodeVariant {
     public:
         using variant::variant;
 
+        Node() = default;
+
+        // Копия не зависит от документа оригинала: списки и строки копируются в ресурс по умолчанию,
+        // имена - в общую таблицу (InternName). Копия документа целиком имена не копирует
+        Node(const Node &other);
+
+        Node(Node &&other) = default;
+
+        Node &operator=(const Node &other);
+
+        Node &operator=(Node &&other) = default;
+
+        // строковый узел из обычной строки, память - из ресурса по умолчанию
+        Node(std::string_view text);
+
         bool IsString() const;
 
         bool IsNull() const;
 
         bool IsArray() const;
 
-        const std::string &AsString() const;
+        // строка хранится в узле, представление действительно, пока жив узел
+        std::string_view AsString() const;
 
         const Array &AsArray() const;
 
         const NodeVariant &GetValue() const;
 
-        Node SetName(const std::string& name);
+        // Сеттеры возвращают ссылку на узел: для временного узла - rvalue-ссылку, чтобы цепочка
+        // вида LoadValue(...).SetName(...).SetId(...) перемещала узел, а не копировала поддерево
+        // Имя хранится в таблице имен, узел держит только ссылку на него. Без таблицы - общая таблица
+        // (InternName) для узлов, построенных вручную; разбор пишет имена в таблицы документа
+        Node &SetName(std::string_view name) &;
+
+        Node &&SetName(std::string_view name) &&;
 
-        const std::string GetName() const;
+        Node &SetName(std::string_view name, SymbolTable &names) &;
 
-        Node SetId(int id);
+        Node &&SetName(std::string_view name, SymbolTable &names) &&;
+
+        // Ссылка действительна, пока жива таблица имени: для разобранного узла - пока жив его документ
+        // или копия документа, для построенного вручную - до конца программы
+        const std::string &GetName() const;
+
+        // Имена из одной таблицы сравниваются по указателям, из разных - по строкам
+        bool HasSameName(const Node &other) const;
+
+        Node &SetId(int id) &;
+
+        Node &&SetId(int id) &&;
 
         const int GetId() const;
 
     private:
-        std::string name_ = "";
+        friend class Document;
+
+        // Копия поддерева без рекурсии, имена копии ссылаются на те же строки таблиц, что и у оригинала
+        static Node CopyTree(const Node &source);
+
+        const std::string *name_ = nullptr;  // nullptr - пустое имя
         int id_ = 0;
     };
 
+    // Память разобранного документа: монотонные арены, из которых узлы и строки выделяются крупными блоками.
+    // Память освобождается вся сразу вместе с документом, без обхода дерева. Арена не потокобезопасна,
+    // поэтому параллельный разбор заводит отдельную арену на каждую часть
+    class DocumentArena {
+    public:
+        // новая арена; первый блок - initial_size байт, следующие растут в геометрической прогрессии
+        std::pmr::memory_resource *AddArena(size_t initial_size);
+
+        // первая арена, из нее выделяется корень документа
+        std::pmr::memory_resource *Front();
+
+    private:
+        std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> arenas_;
+    };
+
     class Document {
     public:
-        explicit Document(Node root);
+        // Дерево в общей куче, при уничтожении документа обходится и освобождается по узлам.
+        // names - таблицы имен узлов дерева, документ и его копии владеют ими совместно
+        explicit Document(Node root, std::shared_ptr<NameTables> names = nullptr);
+
+        // Дерево, все списки и строки которого выделены из арен arena: уничтожение документа
+        // освобождает арены целиком, деструкторы узлов не вызываются
+        Document(Node root, std::unique_ptr<DocumentArena> arena, std::shared_ptr<NameTables> names = nullptr);
+
+        Document(const Document &other);
+
+        Document(Document &&other) noexcept;
+
+        Document &operator=(const Document &other);
+
+        Document &operator=(Document &&other) noexcept;
+
+        // дерево в куче разбирается без рекурсии, чтобы глубокие документы не переполняли стек
+        ~Document();
 
         const Node &GetRoot() const;
 
+        // Хеш значений дерева (HashValues): вычисляется при первом вызове и запоминается
+        uint64_t GetHash() const;
+
+        // Сравниваются значения узлов (имена и id не учитываются). Документы с разными хешами
+        // не равны без обхода деревьев, при совпадении хешей деревья сравниваются полностью
         bool operator==(const Document &rhs) const;
 
         bool operator!=(const Document &rhs) const;
 
     private:
-        Node root_;
+        // правит дерево на месте при повторном разборе части текста
+        friend class IncrementalDocument;
+
+        void Release();
+
+        std::unique_ptr<DocumentArena> arena_;
+        // копия документа разделяет таблицы с оригиналом: узлы копии ссылаются на те же имена
+        std::shared_ptr<NameTables> names_;
+        // Корень лежит в арене (или в куче для документа без арены), поэтому его адрес не меняется
+        // при перемещении документа. nullptr - документ перемещен
+        Node *root_ = nullptr;
+        // 0 - хеш еще не вычислен. Вычисление идемпотентно, поэтому гонка потоков безопасна
+        mutable std::atomic<uint64_t> hash_{0};
     };
 
+    // Уничтожает поддеревья узла без рекурсии, узел остается пустым списком
+    void DestroyTree(Node &node);
+
     class ParsingError : public std::runtime_error {
     public:
         using runtime_error::runtime_error;
     };
 
+    // Бросает ParsingError с единым для всех ошибок формата сообщением
+    [[noreturn]] void ThrowFormatError();
+
+    // Емкость буфера для вывода отдельных строк через PrintContext
+    constexpr size_t kLineBufferCapacity = 4096;
+
     // Контекст вывода, хранит ссылку на поток вывода и текущий отступ
     struct PrintContext {
         std::ostream &out;
         int indent_step = 2;
         int indent = 0;
+        // Буфер, общий для контекста и полученных из него через Indented(): функции вывода через
+        // контекст пишут в него и сбрасывают в out в конце вызова, память на каждый узел не выделяется
+        std::shared_ptr<OutputBuffer> buffer;
 
         PrintContext(std::ostream &out)
-                : out(out) {}
+                : out(out), buffer(std::make_shared<OutputBuffer>(out, kLineBufferCapacity)) {}
 
         PrintContext(std::ostream &out, int indent_step, int indent = 0)
-                : out(out), indent_step(indent_step), indent(indent) {}
+                : out(out), indent_step(indent_step), indent(indent),
+                  buffer(std::make_shared<OutputBuffer>(out, kLineBufferCapacity)) {}
 
         //печатает текущий отступ
         void PrintIndent() const;
@@ -102,12 +223,17 @@ namespace parser {
         return ctx;
     }
 
+    // Строка "{имена потомков}" для узла-списка
+    const PrintContext &operator<<(const PrintContext &ctx, const Array &arr);
+
     // Перегрузка функции PrintValue для вывода значений null
     void PrintValue(std::nullptr_t, const PrintContext &ctx, [[maybe_unused]] int parent_id);
 
     // Перегрузка функции PrintValue для вывода значений string
     void PrintValue(const std::string& text, const PrintContext &ctx, [[maybe_unused]] int parent_id);
 
+    void PrintValue(std::string_view text, const PrintContext &ctx, [[maybe_unused]] int parent_id);
+
     // Перегрузка функции PrintValue для вывода значений array
     void PrintValue(const Array &, const PrintContext &ctx, int parent_id);
 
@@ -115,8 +241,59 @@ namespace parser {
 
     void Print(const Document &doc, std::ostream &out);
 
+    // Вывод через OutputBuffer. Функции с PrintContext выше - обертки над ними
+
+    // Строка "{имена потомков}" для узла-списка
+    void PrintListSummary(const Array &arr, OutputBuffer &out);
+
+    // Потомки списка с id parent_id (вместе со строкой-перечнем их имен), отступ первого уровня - indent
+    void PrintList(const Array &arr, int parent_id, OutputBuffer &out, int indent, int indent_step = 2);
+
+    // Строка узла и все его поддерево
+    void PrintNode(const Node &node, int parent_id, OutputBuffer &out, int indent = 0, int indent_step = 2);
+
+    void Print(const Document &doc, OutputBuffer &out);
+
     Document Load(std::istream &input);
 
+    // Разбор буфера, которым владеет вызывающий. Имена и строки без escape-последовательностей
+    // читаются из буфера без промежуточных копий
+    Document Load(std::string_view input);
+
+    // Разбор с нумерацией узлов от ids: например, поддерева, вырезанного из большего документа
+    Document Load(std::string_view input, IdAllocator &ids);
+
+    // Разбор в память resource, без собственной арены: документ разбирается по узлам.
+    // Ресурс должен пережить документ
+    Document Load(std::string_view input, IdAllocator &ids, std::pmr::memory_resource *resource);
+
+    // Разбор последовательности соседних узлов (части тела списка с id parent_id, без скобок).
+    // Имена узлов добавляются в names, таблица должна пережить узлы.
+    // Вход только из пробельных символов - пустой результат
+    Array LoadSequence(std::string_view input, IdAllocator &ids, int parent_id, SymbolTable &names,
+                       std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    struct ParallelOptions {
+        size_t threads = 0;                         // 0 - по числу аппаратных потоков
+        size_t min_chunk_bytes = size_t{1} << 20;   // меньшие части не выделяются
+        size_t min_chunk_nodes = size_t{1} << 16;   // для вывода: части из меньшего числа узлов не выделяются
+    };
+
+    // Параллельный разбор: дочерние узлы корневого списка делятся на части по границам соседних узлов,
+    // части разбираются на пуле потоков, затем id сдвигаются префиксной суммой числа узлов частей.
+    // Результат и id совпадают с Load(input)
+    Document LoadParallel(std::string_view input, const ParallelOptions &options = {});
+
+    // Параллельный вывод: поддеревья потомков узла (соседние, пока в группе меньше min_chunk_nodes узлов)
+    // форматируются на пуле потоков в отдельные буферы с отступом потомков из ctx, затем буферы
+    // пишутся в ctx.out по порядку. Вывод совпадает с PrintNode(node, ctx)
+    void PrintNodeParallel(const Node &node, const PrintContext &ctx, const ParallelOptions &options = {});
+
+    void PrintParallel(const Document &doc, std::ostream &out, const ParallelOptions &options = {});
+
+    // Разбор файла, отображенного в память. Бросает std::system_error, если файл не открылся
+    Document LoadFile(const std::string &path);
+
     bool operator==(const Node &lhs, const Array &rhs);
 
 } //namespace parser
\ No newline at end of file
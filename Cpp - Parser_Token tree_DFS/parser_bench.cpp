@@ -0,0 +1,586 @@
+#include "parser.h"
+#include "document_generator.h"
+#include "document_index.h"
+#include "lazy_document.h"
+#include "merkle.h"
+#include "flat_document.h"
+#include "incremental.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "lexer.h"
+#include "structural_index.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std::literals;
+
+// Счетчик выделений памяти: глобальные operator new/delete заменены на время работы бенчмарков
+std::atomic<size_t> g_allocations{0};
+
+void *operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    parser::CountAllocation(size);
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+// Пиковый объем резидентной памяти процесса в байтах (VmHWM), 0 - неизвестен
+size_t PeakRss() {
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind("VmHWM:"s, 0) == 0) {
+            return std::stoul(line.substr(6)) * 1024;
+        }
+    }
+#endif
+    return 0;
+}
+
+// Сброс пика до текущего объема, чтобы измерять пик каждого этапа отдельно
+void ResetPeakRss() {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+// Документ из цепочки вложенных списков заданной глубины:
+// n = { n = { ... n = { leaf = "v" } ... } }
+std::string MakeDeepDocument(int depth) {
+    std::string text;
+    text.reserve(depth * 10 + 16);
+    for (int i = 0; i < depth; ++i) {
+        text += "n = { "s;
+    }
+    text += "leaf = \"v\""s;
+    for (int i = 0; i < depth; ++i) {
+        text += " }"s;
+    }
+    return text;
+}
+
+// Документ из одного списка заданной ширины: root = { n = "v" n = "v" ... }
+std::string MakeWideDocument(int width) {
+    std::string text = "root = {"s;
+    text.reserve(width * 10 + 16);
+    for (int i = 0; i < width; ++i) {
+        text += " n = \"v\""s;
+    }
+    text += " }"s;
+    return text;
+}
+
+// Лучшее из нескольких измерений времени, в секундах
+template<typename Action>
+double Measure(Action action, int repeats) {
+    double best = 0;
+    for (int i = 0; i < repeats; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        action();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+double MeasureLoad(const std::string &text, int repeats) {
+    return Measure([&text] { parser::Load(std::string_view(text)); }, repeats);
+}
+
+double MeasurePrint(const parser::Document &doc, int repeats) {
+    return Measure([&doc] {
+        std::ostringstream out;
+        parser::Print(doc, out);
+    }, repeats);
+}
+
+void ReportLine(const std::string &label, int nodes, double seconds) {
+    std::cout << "  "s << std::left << std::setw(24) << label << std::right
+              << std::fixed << std::setprecision(3) << seconds * 1e3 << " ms, "s
+              << std::setprecision(1) << seconds * 1e9 / nodes << " ns/node"s << std::endl;
+}
+
+// Разбор и вывод на глубоких и широких документах одного размера
+void BenchShapes() {
+    std::cout << "Load and Print, deep vs wide"s << std::endl;
+    for (int nodes: {1000, 4000}) {
+        const std::string deep = MakeDeepDocument(nodes);
+        const std::string wide = MakeWideDocument(nodes);
+        const parser::Document deep_doc = parser::Load(std::string_view(deep));
+        const parser::Document wide_doc = parser::Load(std::string_view(wide));
+
+        const std::string suffix = " "s + std::to_string(nodes);
+        ReportLine("load deep"s + suffix, nodes + 1, MeasureLoad(deep, 5));
+        ReportLine("load wide"s + suffix, nodes + 1, MeasureLoad(wide, 5));
+        // вывод глубокого документа дороже из-за отступов: их объем растет с квадратом глубины
+        ReportLine("print deep"s + suffix, nodes + 1, MeasurePrint(deep_doc, 5));
+        ReportLine("print wide"s + suffix, nodes + 1, MeasurePrint(wide_doc, 5));
+    }
+    // глубина, недоступная рекурсивному разбору
+    const int kVeryDeep = 200000;
+    ReportLine("load deep "s + std::to_string(kVeryDeep), kVeryDeep + 1, MeasureLoad(MakeDeepDocument(kVeryDeep), 1));
+    ReportLine("load wide "s + std::to_string(kVeryDeep), kVeryDeep + 1, MeasureLoad(MakeWideDocument(kVeryDeep), 1));
+}
+
+// Типичный документ заданного размера: список из повторяющихся точек со строковыми значениями
+std::string MakeTypicalDocument(size_t bytes) {
+    std::string text = "root = {\n"s;
+    text.reserve(bytes + 128);
+    while (text.size() < bytes) {
+        text += "  point = { x = \"1.2345\" y = \"0.5\" label = \"some quoted text\" }\n"s;
+    }
+    text += "}"s;
+    return text;
+}
+
+void ReportThroughput(const std::string &label, size_t bytes, double seconds) {
+    std::cout << "  "s << std::left << std::setw(24) << label << std::right
+              << std::fixed << std::setprecision(0) << bytes / seconds / 1e6 << " MB/s"s << std::endl;
+}
+
+// Скорость первого прохода (структурный индекс) по сравнению с посимвольным лексером
+void BenchTokenize() {
+    const std::string text = MakeTypicalDocument(64 * 1024 * 1024);
+    std::cout << "Tokenize, "s << text.size() / (1024 * 1024) << " MiB"s << std::endl;
+
+    ReportThroughput("scalar lexer"s, text.size(), Measure([&text] {
+        parser::Lexer lexer(text);
+        while (lexer.Next().type != parser::TokenType::End) {
+        }
+    }, 3));
+    const std::pair<parser::ScanKernel, std::string> kernels[] = {
+            {parser::ScanKernel::Scalar, "index, scalar"s},
+            {parser::ScanKernel::Sse2,   "index, sse2"s},
+            {parser::ScanKernel::Avx2,   "index, avx2"s}};
+    for (const auto &[kernel, label]: kernels) {
+        if (!parser::IsKernelSupported(kernel)) {
+            std::cout << "  "s << label << ": not supported"s << std::endl;
+            continue;
+        }
+        ReportThroughput(label, text.size(), Measure([&text, kernel = kernel] {
+            std::vector<uint64_t> structurals, specials;
+            parser::StructuralScanner scanner(text, kernel);
+            // порциями, как в разборе: индекс не растет вместе с входом
+            while (scanner.ScanChunk(structurals, specials)) {
+                structurals.clear();
+                specials.clear();
+            }
+        }, 3));
+    }
+    ReportThroughput("indexed lexer"s, text.size(), Measure([&text] {
+        parser::IndexedLexer lexer(text);
+        while (lexer.Next().type != parser::TokenType::End) {
+        }
+    }, 3));
+}
+
+// Последовательный и параллельный разбор большого документа
+void BenchParallelLoad() {
+    const std::string text = MakeTypicalDocument(64 * 1024 * 1024);
+    const size_t threads = parser::DefaultThreadCount();
+    std::cout << "Load, "s << text.size() / (1024 * 1024) << " MiB, "s << threads << " threads"s << std::endl;
+    ReportThroughput("sequential"s, text.size(), MeasureLoad(text, 1));
+    ReportThroughput("parallel"s, text.size(), Measure([&text, threads] {
+        parser::LoadParallel(text, {threads, size_t{1} << 20});
+    }, 1));
+}
+
+// Скорость вывода: дерево и плоская таблица, в поток в памяти и в файл
+void BenchPrint() {
+    const std::string text = MakeTypicalDocument(64 * 1024 * 1024);
+    const parser::Document doc = parser::Load(std::string_view(text));
+    const parser::FlatDocument flat = parser::LoadFlat(text);
+
+    std::ostringstream sample;
+    parser::Print(doc, sample);
+    const size_t bytes = sample.str().size();
+    std::cout << "Print, "s << bytes / (1024 * 1024) << " MiB of output"s << std::endl;
+
+    ReportThroughput("tree to string"s, bytes, Measure([&doc] {
+        std::ostringstream out;
+        parser::Print(doc, out);
+    }, 3));
+    ReportThroughput("flat to string"s, bytes, Measure([&flat] {
+        std::ostringstream out;
+        parser::Print(flat, out);
+    }, 3));
+    ReportThroughput("tree to buffer"s, bytes, Measure([&doc] {
+        parser::OutputBuffer out;
+        parser::Print(doc, out);
+    }, 3));
+    // потоков по числу ядер; на одном ядре PrintParallel выводит последовательно
+    ReportThroughput("tree, parallel"s, bytes, Measure([&doc] {
+        std::ostringstream out;
+        parser::PrintParallel(doc, out);
+    }, 3));
+    ReportThroughput("flat, parallel"s, bytes, Measure([&flat] {
+        std::ostringstream out;
+        parser::PrintParallel(flat.View(), out);
+    }, 3));
+}
+
+// Запуск с готового снимка вместо разбора текста
+void BenchSnapshot() {
+    const std::string text = MakeTypicalDocument(64 * 1024 * 1024);
+    const auto path = std::filesystem::temp_directory_path() / "parser_bench_snapshot.bin";
+    {
+        std::ofstream file(path, std::ios::binary);
+        parser::WriteSnapshot(parser::LoadFlat(text).View(), file);
+    }
+    std::cout << "Startup, "s << text.size() / (1024 * 1024) << " MiB text, "s
+              << std::filesystem::file_size(path) / (1024 * 1024) << " MiB snapshot"s << std::endl;
+
+    ReportThroughput("parse flat"s, text.size(), Measure([&text] { parser::LoadFlat(text); }, 3));
+    ReportThroughput("open snapshot"s, text.size(), Measure([&path] { parser::Snapshot snapshot(path.string()); }, 3));
+    ReportThroughput("open and print"s, text.size(), Measure([&path] {
+        parser::Snapshot snapshot(path.string());
+        parser::OutputBuffer out;
+        parser::Print(snapshot.View(), out);
+    }, 3));
+    std::filesystem::remove(path);
+}
+
+// Поиск узлов через индекс: построение и отдельные запросы
+void BenchIndex() {
+    const std::string text = MakeTypicalDocument(16 * 1024 * 1024);
+    const parser::Document doc = parser::Load(std::string_view(text));
+    const int kLookups = 100000;
+    std::cout << "Index, "s << text.size() / (1024 * 1024) << " MiB"s << std::endl;
+
+    const auto ReportLookup = [](const std::string &label, double seconds, int count) {
+        std::cout << "  "s << std::left << std::setw(24) << label << std::right
+                  << std::fixed << std::setprecision(1) << seconds * 1e9 / count << " ns/lookup"s << std::endl;
+    };
+
+    parser::DocumentIndex index(doc);
+    const int points = static_cast<int>(doc.GetRoot().AsArray().size());
+    const double build = Measure([&index] { index.FindById(1); }, 1);
+    std::cout << "  "s << std::left << std::setw(24) << "first lookup (build)"s << std::right
+              << std::fixed << std::setprecision(3) << build * 1e3 << " ms"s << std::endl;
+    ReportLookup("by id"s, Measure([&index, points] {
+        for (int i = 0; i < kLookups; ++i) {
+            index.FindById(1 + (i * 7919) % (points * 4));
+        }
+    }, 3), kLookups);
+
+    std::vector<std::string> paths;
+    for (int i = 0; i < 1000; ++i) {
+        paths.push_back("root/point["s + std::to_string((i * 7919) % points) + "]/label"s);
+    }
+    index.FindByPath(paths[0]);
+    ReportLookup("by path"s, Measure([&index, &paths] {
+        for (int i = 0; i < kLookups; ++i) {
+            index.FindByPath(paths[i % paths.size()]);
+        }
+    }, 3), kLookups);
+}
+
+// Ленивый документ: одно поддерево из большого документа против полного разбора
+void BenchLazy() {
+    const std::string text = MakeTypicalDocument(64 * 1024 * 1024);
+    std::cout << "Lazy, "s << text.size() / (1024 * 1024) << " MiB"s << std::endl;
+
+    ReportThroughput("full load"s, text.size(), MeasureLoad(text, 1));
+    ReportThroughput("lazy, one subtree"s, text.size(), Measure([&text] {
+        parser::LazyDocument lazy(text);
+        lazy.GetNode(*lazy.FindByPath("root/point[1000]/label"sv));
+    }, 3));
+    // в типичном документе почти все узлы - потомки корня, поэтому основное время - просмотр его тела
+    ReportThroughput("lazy, nested subtree"s, text.size(), Measure([&text] {
+        parser::LazyDocument lazy(text);
+        lazy.GetNode(*lazy.FindByPath("root/point/x"sv));
+    }, 3));
+}
+
+// Правки в середине большого документа: повторный разбор затронутого узла против полного разбора
+// нового текста. Правка, меняющая число узлов, перенумеровывает весь хвост документа
+void BenchIncremental() {
+    const std::string text = MakeTypicalDocument(64 * 1024 * 1024);
+    std::cout << "Incremental, "s << text.size() / (1024 * 1024) << " MiB"s << std::endl;
+
+    ReportThroughput("full load"s, text.size(), MeasureLoad(text, 1));
+    parser::IncrementalDocument doc(text);
+    const size_t pos = text.find("\"0.5\""sv, text.size() / 2) + 1;
+    const size_t after = pos + 4;   // за закрывающей кавычкой
+
+    // пары правок возвращают текст к исходному
+    const auto report = [&doc](const std::string &label, int edits, auto edit) {
+        const double seconds = Measure([&doc, edits, &edit] {
+            for (int i = 0; i < edits; ++i) {
+                edit(doc, i % 2 == 0);
+            }
+        }, 3);
+        std::cout << "  "s << std::left << std::setw(24) << label << std::right
+                  << std::fixed << std::setprecision(2) << seconds * 1e6 / edits << " us/edit"s << std::endl;
+    };
+    report("same-length value"s, 1000, [pos](parser::IncrementalDocument &doc, bool forward) {
+        doc.ApplyEdit(pos, pos + 1, forward ? "1"sv : "0"sv);
+    });
+    report("new-length value"s, 1000, [pos](parser::IncrementalDocument &doc, bool forward) {
+        doc.ApplyEdit(pos, pos + (forward ? 1 : 2), forward ? "10"sv : "0"sv);
+    });
+    report("add or remove node"s, 20, [after](parser::IncrementalDocument &doc, bool forward) {
+        constexpr std::string_view node = " e = null"sv;
+        doc.ApplyEdit(after, forward ? after : after + node.size(), forward ? node : ""sv);
+    });
+}
+
+// Сравнение двух версий документа, отличающихся одним значением
+void BenchDiff() {
+    std::string text = MakeTypicalDocument(64 * 1024 * 1024);
+    const parser::Document before = parser::Load(std::string_view(text));
+    text[text.find("\"0.5\""sv, text.size() / 2) + 1] = '1';
+    const parser::Document after = parser::Load(std::string_view(text));
+    std::cout << "Diff, "s << text.size() / (1024 * 1024) << " MiB"s << std::endl;
+
+    ReportThroughput("compare values"s, text.size(), Measure([&before, &after] {
+        parser::EqualValues(before.GetRoot(), after.GetRoot());
+    }, 1));
+    ReportThroughput("first ==, hashing"s, text.size(), Measure([&before, &after] { (void) (before == after); }, 1));
+    ReportThroughput("==, cached hashes"s, text.size(), Measure([&before, &after] { (void) (before == after); }, 3));
+    ReportThroughput("build merkle trees"s, text.size(), Measure([&before, &after] {
+        parser::MerkleTree a(before);
+        parser::MerkleTree b(after);
+    }, 1));
+    const parser::MerkleTree a(before);
+    const parser::MerkleTree b(after);
+    ReportThroughput("diff"s, text.size(), Measure([&a, &b] { parser::Diff(a, b); }, 3));
+}
+
+// Этап набора бенчмарков: лучшее время, число выделений памяти за один запуск и пик памяти
+struct StageResult {
+    double seconds = 0;
+    size_t allocations = 0;
+    size_t peak_rss = 0;
+};
+
+template<typename Action>
+StageResult MeasureStage(Action action, int repeats) {
+    // выделения и пик памяти считаются по первому запуску, время - лучшее из всех
+    StageResult result;
+    ResetPeakRss();
+    const size_t before = g_allocations.load();
+    result.seconds = Measure(action, 1);
+    result.allocations = g_allocations.load() - before;
+    result.peak_rss = PeakRss();
+    if (repeats > 1) {
+        result.seconds = std::min(result.seconds, Measure(action, repeats - 1));
+    }
+    return result;
+}
+
+void ReportStage(const std::string &label, size_t bytes, size_t nodes, const StageResult &stage) {
+    std::cout << "  "s << std::left << std::setw(14) << label << std::right << std::fixed
+              << std::setprecision(0) << std::setw(6) << bytes / stage.seconds / 1e6 << " MB/s "s
+              << std::setprecision(2) << std::setw(7) << nodes / stage.seconds / 1e6 << " Mnodes/s "s
+              << std::setw(6) << static_cast<double>(stage.allocations) / nodes << " allocs/node "s;
+    if (stage.peak_rss) {
+        std::cout << std::setprecision(0) << std::setw(6) << stage.peak_rss / (1024.0 * 1024.0) << " MiB peak RSS"s;
+    } else {
+        std::cout << "    n/a peak RSS"s;
+    }
+    std::cout << std::endl;
+}
+
+// Синтетические документы разной формы (seed фиксирован, результаты сравнимы между запусками):
+// разбор, вывод и полный круг текст - дерево - снимок - вывод
+void BenchSuite() {
+    struct Config {
+        std::string name;
+        parser::GeneratorOptions options;
+    };
+    std::vector<Config> configs(6);
+    configs[0].name = "typical"s;
+    configs[0].options.width = 16;
+    configs[0].options.depth = 5;
+    configs[1].name = "wide"s;
+    configs[1].options.width = 1 << 20;
+    configs[1].options.depth = 1;
+    configs[2].name = "deep"s;
+    configs[2].options.width = 2;
+    configs[2].options.depth = 20;
+    configs[3].name = "long strings"s;
+    configs[3].options.width = 64;
+    configs[3].options.depth = 2;
+    configs[3].options.string_length = 4096;
+    configs[4].name = "escapes"s;
+    configs[4].options.width = 16;
+    configs[4].options.depth = 5;
+    configs[4].options.escape_density = 0.2;
+    configs[5].name = "unique names"s;
+    configs[5].options.width = 16;
+    configs[5].options.depth = 5;
+    configs[5].options.distinct_names = 1 << 24;
+
+    for (const auto &[name, options]: configs) {
+        const parser::GeneratedDocument generated = parser::GenerateDocument(options);
+        const std::string &text = generated.text;
+        const size_t nodes = generated.nodes;
+        std::cout << "Suite: "s << name << ", "s << text.size() / (1024 * 1024) << " MiB, "s
+                  << nodes << " nodes"s << std::endl;
+
+        const StageResult load = MeasureStage([&text] { parser::Load(std::string_view(text)); }, 3);
+        const parser::Document doc = parser::Load(std::string_view(text));
+        std::string expected;
+        {
+            parser::OutputBuffer out;
+            parser::Print(doc, out);
+            expected = out.Take();
+        }
+        const StageResult print = MeasureStage([&doc] {
+            parser::OutputBuffer out;
+            parser::Print(doc, out);
+        }, 3);
+        std::string actual;
+        const StageResult round_trip = MeasureStage([&text, &actual] {
+            std::ostringstream snapshot;
+            parser::WriteSnapshot(parser::Load(std::string_view(text)), snapshot);
+            const std::string bytes = snapshot.str();
+            parser::OutputBuffer out;
+            parser::Print(parser::ReadSnapshot(bytes), out);
+            actual = out.Take();
+        }, 1);
+        if (actual != expected) {
+            std::cout << "FAILED: round trip output differs"s << std::endl;
+        }
+
+        ReportStage("load"s, text.size(), nodes, load);
+        ReportStage("print"s, expected.size(), nodes, print);
+        ReportStage("round trip"s, text.size(), nodes, round_trip);
+    }
+}
+
+// Регрессионный бенчмарк: время разбора глубокого документа должно расти линейно с глубиной.
+// При удвоении глубины время не должно расти больше чем в kMaxGrowth раз
+int BenchDeepLoad() {
+    const double kMaxGrowth = 3.0;
+    const std::vector<int> depths{1000, 2000, 4000, 8000};
+
+    std::cout << "Load, deep documents"s << std::endl;
+    bool linear = true;
+    double prev = 0;
+    for (int depth: depths) {
+        const double seconds = MeasureLoad(MakeDeepDocument(depth), 5);
+        std::cout << "  depth "s << std::setw(6) << depth << ": "s
+                  << std::fixed << std::setprecision(3) << seconds * 1e3 << " ms, "s
+                  << std::setprecision(1) << seconds * 1e9 / (depth + 1) << " ns/node"s;
+        if (prev > 0) {
+            const double growth = seconds / prev;
+            std::cout << ", x"s << std::setprecision(2) << growth;
+            linear = linear && growth <= kMaxGrowth;
+        }
+        std::cout << std::endl;
+        prev = seconds;
+    }
+
+    if (!linear) {
+        std::cout << "FAILED: load time grows faster than depth"s << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Параметры генератора из аргументов вида ключ=значение
+bool ParseGeneratorOptions(int argc, char **argv, parser::GeneratorOptions &options) {
+    for (int i = 0; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const size_t eq = arg.find('=');
+        if (eq == std::string_view::npos) {
+            return false;
+        }
+        const std::string_view key = arg.substr(0, eq);
+        const std::string value(arg.substr(eq + 1));
+        if (key == "seed"sv) {
+            options.seed = static_cast<uint32_t>(std::stoul(value));
+        } else if (key == "width"sv) {
+            options.width = std::stoi(value);
+        } else if (key == "depth"sv) {
+            options.depth = std::stoi(value);
+        } else if (key == "string_length"sv) {
+            options.string_length = std::stoul(value);
+        } else if (key == "escape_density"sv) {
+            options.escape_density = std::stod(value);
+        } else if (key == "distinct_names"sv) {
+            options.distinct_names = std::stoul(value);
+        } else if (key == "null_share"sv) {
+            options.null_share = std::stod(value);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Без аргументов - все бенчмарки, --suite - только набор на синтетических документах,
+// --generate файл [ключ=значение ...] - записать синтетический документ в файл
+int main(int argc, char **argv) {
+    if (argc >= 3 && argv[1] == "--generate"sv) {
+        parser::GeneratorOptions options;
+        try {
+            if (!ParseGeneratorOptions(argc - 3, argv + 3, options)) {
+                return -1;
+            }
+            std::ofstream file(argv[2], std::ios::binary);
+            file << parser::GenerateDocument(options).text;
+            return file ? 0 : -1;
+        } catch (const std::exception &) {
+            return -1;
+        }
+    }
+    if (argc == 2 && argv[1] == "--suite"sv) {
+        BenchSuite();
+        return 0;
+    }
+    if (argc != 1) {
+        return -1;
+    }
+
+    const int result = BenchDeepLoad();
+    BenchShapes();
+    BenchTokenize();
+    BenchParallelLoad();
+    BenchPrint();
+    BenchSnapshot();
+    BenchIndex();
+    BenchLazy();
+    BenchIncremental();
+    BenchDiff();
+    BenchSuite();
+    return result;
+}
@@ -0,0 +1,164 @@
+#include "snapshot.h"
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace parser {
+
+    static_assert(std::is_trivially_copyable_v<FlatNode>, "FlatNode is stored in snapshots as raw bytes");
+    static_assert(sizeof(FlatNode) % alignof(PoolString) == 0, "symbols follow the nodes without padding");
+
+    constexpr char kSnapshotMagic[8] = {'P', 'R', 'S', 'N', 'A', 'P', '\0', '\0'};
+    constexpr uint32_t kByteOrderMark = 0x01020304;
+
+    // смещение, выровненное вверх до границы узлов
+    uint64_t AlignToNodes(uint64_t offset) {
+        const uint64_t align = alignof(FlatNode);
+        return (offset + align - 1) / align * align;
+    }
+
+    bool IsSnapshot(std::string_view data) {
+        return data.size() >= sizeof(kSnapshotMagic)
+               && std::memcmp(data.data(), kSnapshotMagic, sizeof(kSnapshotMagic)) == 0;
+    }
+
+    void WriteSnapshot(const FlatView &doc, std::ostream &out) {
+        SnapshotHeader header{};
+        std::memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+        header.version = kSnapshotVersion;
+        header.byte_order = kByteOrderMark;
+        header.header_size = sizeof(SnapshotHeader);
+        header.node_size = sizeof(FlatNode);
+        header.node_count = doc.Size();
+        header.nodes_offset = AlignToNodes(sizeof(SnapshotHeader));
+        header.symbol_count = doc.SymbolCount();
+        header.symbols_offset = header.nodes_offset + header.node_count * sizeof(FlatNode);
+        header.pool_offset = header.symbols_offset + header.symbol_count * sizeof(PoolString);
+        header.pool_size = doc.GetPool().size();
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        const std::string padding(header.nodes_offset - sizeof(header), '\0');
+        out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+        // узлы переписываются по полям в обнуленную запись, чтобы байты выравнивания
+        // в снимке не зависели от содержимого памяти
+        for (uint32_t id = 1; id <= doc.Size(); ++id) {
+            const FlatNode &node = doc.GetNode(id);
+            FlatNode record;
+            std::memset(static_cast<void *>(&record), 0, sizeof(record));
+            record.parent_id = node.parent_id;
+            record.first_child = node.first_child;
+            record.next_sibling = node.next_sibling;
+            record.last_descendant = node.last_descendant;
+            record.name = node.name;
+            record.kind = node.kind;
+            record.value.offset = node.value.offset;
+            record.value.size = node.value.size;
+            out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+        for (size_t i = 0; i < doc.SymbolCount(); ++i) {
+            PoolString record;
+            std::memset(static_cast<void *>(&record), 0, sizeof(record));
+            record.offset = doc.GetSymbols()[i].offset;
+            record.size = doc.GetSymbols()[i].size;
+            out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+        }
+        out.write(doc.GetPool().data(), static_cast<std::streamsize>(doc.GetPool().size()));
+    }
+
+    void WriteSnapshot(const Document &doc, std::ostream &out) {
+        WriteSnapshot(Flatten(doc).View(), out);
+    }
+
+    // строка лежит в пуле размера pool_size
+    bool InPool(PoolString str, uint64_t pool_size) {
+        return str.offset <= pool_size && str.size <= pool_size - str.offset;
+    }
+
+    // Проверка связей узлов из файла: ссылки ведут вперед в пределах поддерева родителя, поэтому
+    // обход по first_child / next_sibling конечен, а стек открытых списков при выводе согласован
+    void CheckNodes(const FlatNode *nodes, uint64_t node_count, const PoolString *symbols, uint64_t symbol_count,
+                    uint64_t pool_size) {
+        using namespace std::literals;
+
+        for (uint64_t i = 0; i < symbol_count; ++i) {
+            if (!InPool(symbols[i], pool_size)) {
+                throw ParsingError("Неверная строка имени в снимке"s);
+            }
+        }
+        for (uint64_t id = 1; id <= node_count; ++id) {
+            const FlatNode &node = nodes[id - 1];
+            // родитель предшествует узлу (у корня его нет); проверяется до чтения записи родителя
+            if (id == 1 ? node.parent_id != 0 : node.parent_id == 0 || node.parent_id >= id) {
+                throw ParsingError("Неверный узел в снимке: "s + std::to_string(id));
+            }
+            // родитель уже проверен: его поддерево должно покрывать узел
+            const uint64_t parent_last = node.parent_id ? nodes[node.parent_id - 1].last_descendant : node_count;
+            const bool linked = id <= parent_last
+                                && node.last_descendant >= id && node.last_descendant <= parent_last
+                                && (node.first_child == 0
+                                    || (node.first_child > id && node.first_child <= node.last_descendant
+                                        && nodes[node.first_child - 1].parent_id == id))
+                                && (node.next_sibling == 0
+                                    || (node.parent_id != 0 && node.next_sibling > node.last_descendant
+                                        && node.next_sibling <= parent_last
+                                        && nodes[node.next_sibling - 1].parent_id == node.parent_id));
+            const bool valid = node.name < symbol_count
+                               && (node.kind == NodeKind::List
+                                   || (node.first_child == 0 && node.last_descendant == id
+                                       && (node.kind == NodeKind::Null
+                                           || (node.kind == NodeKind::String && InPool(node.value, pool_size)))));
+            if (!linked || !valid) {
+                throw ParsingError("Неверный узел в снимке: "s + std::to_string(id));
+            }
+        }
+    }
+
+    FlatView ReadSnapshot(std::string_view data) {
+        using namespace std::literals;
+
+        SnapshotHeader header;
+        if (!IsSnapshot(data) || data.size() < sizeof(header)) {
+            throw ParsingError("Неверный формат снимка"s);
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (header.version != kSnapshotVersion) {
+            throw ParsingError("Неподдерживаемая версия снимка: "s + std::to_string(header.version));
+        }
+        if (header.byte_order != kByteOrderMark || header.header_size != sizeof(SnapshotHeader)
+            || header.node_size != sizeof(FlatNode)) {
+            throw ParsingError("Снимок записан на несовместимой платформе"s);
+        }
+
+        const uint64_t nodes_bytes = header.node_count * sizeof(FlatNode);
+        const bool aligned = reinterpret_cast<uintptr_t>(data.data() + header.nodes_offset) % alignof(FlatNode) == 0;
+        if (header.nodes_offset < sizeof(header) || header.nodes_offset > data.size() || !aligned
+            || header.node_count > (data.size() - header.nodes_offset) / sizeof(FlatNode)
+            || header.symbols_offset != header.nodes_offset + nodes_bytes
+            || header.symbol_count > (data.size() - header.symbols_offset) / sizeof(PoolString)
+            || header.pool_offset != header.symbols_offset + header.symbol_count * sizeof(PoolString)
+            || header.pool_size != data.size() - header.pool_offset) {
+            throw ParsingError("Неверный формат снимка"s);
+        }
+
+        const auto *nodes = reinterpret_cast<const FlatNode *>(data.data() + header.nodes_offset);
+        const auto *symbols = reinterpret_cast<const PoolString *>(data.data() + header.symbols_offset);
+        CheckNodes(nodes, header.node_count, symbols, header.symbol_count, header.pool_size);
+
+        return {nodes,
+                static_cast<size_t>(header.node_count),
+                symbols,
+                static_cast<size_t>(header.symbol_count),
+                data.substr(header.pool_offset)};
+    }
+
+    Snapshot::Snapshot(const std::string &path)
+            : file_(path), view_(ReadSnapshot(file_.Data())) {
+    }
+
+    const FlatView &Snapshot::View() const {
+        return view_;
+    }
+
+} //namespace parser
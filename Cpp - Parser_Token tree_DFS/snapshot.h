@@ -0,0 +1,60 @@
+#pragma once
+
+#include "flat_document.h"
+#include "mapped_file.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace parser {
+
+    // Двоичный снимок разобранного документа: заголовок, таблица узлов FlatNode, таблица символов имен
+    // и пул строк.
+    // Таблица записывается в том виде, в котором лежит в памяти, поэтому снимок читается
+    // без десериализации: после проверки заголовка узлы используются прямо из отображенного файла.
+    // Формат зависит от порядка байт и выравнивания платформы, они проверяются по заголовку
+    constexpr uint32_t kSnapshotVersion = 2;
+
+    struct SnapshotHeader {
+        char magic[8];           // "PRSNAP\0\0"
+        uint32_t version;        // kSnapshotVersion
+        uint32_t byte_order;     // 0x01020304 в порядке байт записавшей платформы
+        uint32_t header_size;    // sizeof(SnapshotHeader)
+        uint32_t node_size;      // sizeof(FlatNode)
+        uint64_t node_count;
+        uint64_t nodes_offset;   // от начала снимка, кратно alignof(FlatNode)
+        uint64_t symbol_count;
+        uint64_t symbols_offset; // таблица PoolString, сразу за узлами
+        uint64_t pool_offset;
+        uint64_t pool_size;
+    };
+
+    // Начинаются ли данные с сигнатуры снимка
+    bool IsSnapshot(std::string_view data);
+
+    void WriteSnapshot(const FlatView &doc, std::ostream &out);
+
+    void WriteSnapshot(const Document &doc, std::ostream &out);
+
+    // Проверяет заголовок и связи узлов и возвращает представление узлов прямо в data, без копирования.
+    // Неверный заголовок, размеры, ссылка между узлами, символ имени или строка - ParsingError:
+    // после проверки обход и вывод снимка из чужого файла гарантированно конечны
+    FlatView ReadSnapshot(std::string_view data);
+
+    // Снимок в отображенном в память файле. Таблица узлов читается один раз при проверке,
+    // пул строк подгружается по мере обращения
+    class Snapshot {
+    public:
+        // бросает std::system_error, если файл не открылся, и ParsingError, если это не снимок
+        explicit Snapshot(const std::string &path);
+
+        const FlatView &View() const;
+
+    private:
+        MappedFile file_;
+        FlatView view_;
+    };
+
+} //namespace parser
@@ -0,0 +1,108 @@
+#include "stats.h"
+
+namespace parser {
+
+    void WriteStatsJson(const ParseStats &stats, std::ostream &out) {
+        out << "{\"bytes_scanned\":" << stats.bytes_scanned
+            << ",\"nodes\":" << stats.nodes
+            << ",\"strings\":" << stats.strings
+            << ",\"allocations\":" << stats.allocations
+            << ",\"allocated_bytes\":" << stats.allocated_bytes
+            << ",\"max_depth\":" << stats.max_depth
+            << ",\"tokenize_ns\":" << stats.tokenize_ns
+            << ",\"build_ns\":" << stats.build_ns
+            << ",\"emit_ns\":" << stats.emit_ns << '}';
+    }
+
+#ifdef PARSER_STATS
+    namespace stats_detail {
+
+        namespace {
+            thread_local Counters *current = nullptr;
+            // активные замеры фаз потока и его время первого прохода (для вычитания из build)
+            thread_local int active[3] = {0, 0, 0};
+            thread_local uint64_t thread_tokenize_ns = 0;
+        }
+
+        Counters *Current() {
+            return current;
+        }
+
+        ScopedCounters::ScopedCounters(Counters *counters)
+                : prev_(current) {
+            current = counters;
+        }
+
+        ScopedCounters::~ScopedCounters() {
+            current = prev_;
+        }
+
+        void UpdateMax(std::atomic<uint64_t> &target, uint64_t value) {
+            uint64_t seen = target.load(std::memory_order_relaxed);
+            while (seen < value && !target.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        PhaseTimer::PhaseTimer(Phase phase)
+                : phase_(phase), counters_(current) {
+            if (counters_ && active[static_cast<int>(phase_)]++ == 0) {
+                outer_ = true;
+                tokenize_before_ = thread_tokenize_ns;
+                start_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        PhaseTimer::~PhaseTimer() {
+            if (!counters_) {
+                return;
+            }
+            --active[static_cast<int>(phase_)];
+            if (!outer_) {
+                return;
+            }
+            const auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start_).count());
+            switch (phase_) {
+                case Phase::Tokenize:
+                    thread_tokenize_ns += elapsed;
+                    counters_->tokenize_ns.fetch_add(elapsed, std::memory_order_relaxed);
+                    break;
+                case Phase::Build: {
+                    const uint64_t tokenize = thread_tokenize_ns - tokenize_before_;
+                    counters_->build_ns.fetch_add(elapsed > tokenize ? elapsed - tokenize : 0,
+                                                  std::memory_order_relaxed);
+                    break;
+                }
+                case Phase::Emit:
+                    counters_->emit_ns.fetch_add(elapsed, std::memory_order_relaxed);
+                    break;
+            }
+        }
+
+    } // namespace stats_detail
+#endif
+
+    StatsScope::StatsScope()
+#ifdef PARSER_STATS
+            : scoped_(&counters_)
+#endif
+    {
+    }
+
+    ParseStats StatsScope::Get() const {
+        ParseStats stats;
+#ifdef PARSER_STATS
+        stats.bytes_scanned = counters_.bytes_scanned.load();
+        stats.nodes = counters_.nodes.load();
+        stats.strings = counters_.strings.load();
+        stats.allocations = counters_.allocations.load();
+        stats.allocated_bytes = counters_.allocated_bytes.load();
+        stats.max_depth = counters_.max_depth.load();
+        stats.tokenize_ns = counters_.tokenize_ns.load();
+        stats.build_ns = counters_.build_ns.load();
+        stats.emit_ns = counters_.emit_ns.load();
+#endif
+        return stats;
+    }
+
+} //namespace parser
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#ifdef PARSER_STATS
+#include <atomic>
+#include <chrono>
+#endif
+
+namespace parser {
+
+    // Статистика разбора и вывода. Собирается, только если библиотека собрана с PARSER_STATS
+    // (опция CMake). Без нее точки сбора компилируются в пустоту, а StatsScope всегда возвращает нули
+#ifdef PARSER_STATS
+    constexpr bool kStatsEnabled = true;
+#else
+    constexpr bool kStatsEnabled = false;
+#endif
+
+    struct ParseStats {
+        uint64_t bytes_scanned = 0;     // байт входа, прошедших через первый проход (структурный индекс)
+        uint64_t nodes = 0;             // узлов, разобранных парсером
+        uint64_t strings = 0;           // из них строковых значений
+        uint64_t allocations = 0;       // выделений памяти, о которых сообщил CountAllocation
+        uint64_t allocated_bytes = 0;
+        uint64_t max_depth = 0;         // наибольшая вложенность списков
+        // Время фаз в наносекундах. В параллельных функциях время потоков складывается.
+        // При потоковой конвертации вывод идет вместе с разбором и попадает в build
+        uint64_t tokenize_ns = 0;       // первый проход
+        uint64_t build_ns = 0;          // второй проход и построение документа
+        uint64_t emit_ns = 0;           // вывод
+    };
+
+    // Одна строка JSON со всеми полями ParseStats
+    void WriteStatsJson(const ParseStats &stats, std::ostream &out);
+
+    namespace stats_detail {
+
+#ifdef PARSER_STATS
+        struct Counters {
+            std::atomic<uint64_t> bytes_scanned{0};
+            std::atomic<uint64_t> nodes{0};
+            std::atomic<uint64_t> strings{0};
+            std::atomic<uint64_t> allocations{0};
+            std::atomic<uint64_t> allocated_bytes{0};
+            std::atomic<uint64_t> max_depth{0};
+            std::atomic<uint64_t> tokenize_ns{0};
+            std::atomic<uint64_t> build_ns{0};
+            std::atomic<uint64_t> emit_ns{0};
+        };
+
+        // счетчики, в которые пишет текущий поток (nullptr - сбор не идет)
+        Counters *Current();
+
+        // Назначает текущему потоку счетчики на время жизни объекта. Пул потоков назначает
+        // своим потокам счетчики вызывающего, поэтому параллельные функции тоже учитываются
+        class ScopedCounters {
+        public:
+            explicit ScopedCounters(Counters *counters);
+
+            ScopedCounters(const ScopedCounters &) = delete;
+
+            ScopedCounters &operator=(const ScopedCounters &) = delete;
+
+            ~ScopedCounters();
+
+        private:
+            Counters *prev_;
+        };
+
+        void UpdateMax(std::atomic<uint64_t> &target, uint64_t value);
+
+        enum class Phase {
+            Tokenize,
+            Build,
+            Emit
+        };
+
+        // Замер фазы. Вложенные замеры той же фазы в одном потоке не учитываются,
+        // из build вычитается время первого прохода, выполненного внутри него
+        class PhaseTimer {
+        public:
+            explicit PhaseTimer(Phase phase);
+
+            PhaseTimer(const PhaseTimer &) = delete;
+
+            PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+            ~PhaseTimer();
+
+        private:
+            Phase phase_;
+            Counters *counters_;
+            bool outer_ = false;
+            uint64_t tokenize_before_ = 0;
+            std::chrono::steady_clock::time_point start_;
+        };
+#endif
+
+    } // namespace stats_detail
+
+    // Сбор статистики в текущем потоке (и в потоках пула, запущенных из него) на время жизни объекта.
+    // Области могут быть вложенными, внутренняя на время своей жизни перехватывает сбор
+    class StatsScope {
+    public:
+        StatsScope();
+
+        StatsScope(const StatsScope &) = delete;
+
+        StatsScope &operator=(const StatsScope &) = delete;
+
+        ParseStats Get() const;
+
+#ifdef PARSER_STATS
+    private:
+        stats_detail::Counters counters_;
+        stats_detail::ScopedCounters scoped_;
+#endif
+    };
+
+    // Хук аллокатора: приложение вызывает его из своей замены operator new, выделение засчитывается
+    // активной в потоке StatsScope. Без PARSER_STATS - пустая функция
+    inline void CountAllocation([[maybe_unused]] size_t bytes) {
+#ifdef PARSER_STATS
+        if (stats_detail::Counters *counters = stats_detail::Current()) {
+            counters->allocations.fetch_add(1, std::memory_order_relaxed);
+            counters->allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+#endif
+    }
+
+} //namespace parser
+
+// Точки сбора внутри библиотеки
+#ifdef PARSER_STATS
+#define PARSER_STATS_CONCAT_IMPL(a, b) a##b
+#define PARSER_STATS_CONCAT(a, b) PARSER_STATS_CONCAT_IMPL(a, b)
+#define PARSER_STATS_ADD(field, value)                                                              \
+    do {                                                                                            \
+        if (::parser::stats_detail::Counters *stats_counters_ = ::parser::stats_detail::Current()) { \
+            stats_counters_->field.fetch_add((value), std::memory_order_relaxed);                   \
+        }                                                                                           \
+    } while (false)
+#define PARSER_STATS_MAX(field, value)                                                              \
+    do {                                                                                            \
+        if (::parser::stats_detail::Counters *stats_counters_ = ::parser::stats_detail::Current()) { \
+            ::parser::stats_detail::UpdateMax(stats_counters_->field, (value));                     \
+        }                                                                                           \
+    } while (false)
+#define PARSER_STATS_PHASE(phase) \
+    ::parser::stats_detail::PhaseTimer PARSER_STATS_CONCAT(stats_timer_, __LINE__)(::parser::stats_detail::Phase::phase)
+#else
+#define PARSER_STATS_ADD(field, value) ((void) 0)
+#define PARSER_STATS_MAX(field, value) ((void) 0)
+#define PARSER_STATS_PHASE(phase) ((void) 0)
+#endif
@@ -0,0 +1,343 @@
+#include "structural_index.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARSER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// AVX2 собирается отдельной функцией и выбирается во время выполнения
+#define PARSER_HAVE_AVX2 1
+#define PARSER_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(__AVX2__)
+#define PARSER_HAVE_AVX2 1
+#define PARSER_TARGET_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace parser {
+
+    using BlockMasks = StructuralScanner::BlockMasks;
+
+    int TrailingZeros(uint64_t mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, mask);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctzll(mask);
+#endif
+    }
+
+    // Бит i результата - xor битов 0..i: единицы от открывающей кавычки (включительно)
+    // до закрывающей (не включительно)
+    uint64_t PrefixXor(uint64_t mask) {
+        mask ^= mask << 1;
+        mask ^= mask << 2;
+        mask ^= mask << 4;
+        mask ^= mask << 8;
+        mask ^= mask << 16;
+        mask ^= mask << 32;
+        return mask;
+    }
+
+    void AppendPositions(uint64_t mask, uint64_t base, std::vector<uint64_t> &positions) {
+        for (; mask; mask &= mask - 1) {
+            positions.push_back(base + TrailingZeros(mask));
+        }
+    }
+
+    void ClassifyScalar(const char *block, BlockMasks &masks) {
+        masks = {};
+        for (int i = 0; i < 64; ++i) {
+            const uint64_t bit = uint64_t{1} << i;
+            switch (block[i]) {
+                case '"':
+                    masks.quote |= bit;
+                    break;
+                case '\\':
+                    masks.backslash |= bit;
+                    break;
+                case '{':
+                case '}':
+                case '=':
+                    masks.structural |= bit;
+                    break;
+                case '\n':
+                case '\r':
+                    masks.newline |= bit;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+#ifdef PARSER_HAVE_SSE2
+
+    void ClassifySse2(const char *block, BlockMasks &masks) {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i open = _mm_set1_epi8('{');
+        const __m128i close = _mm_set1_epi8('}');
+        const __m128i assign = _mm_set1_epi8('=');
+        const __m128i lf = _mm_set1_epi8('\n');
+        const __m128i cr = _mm_set1_epi8('\r');
+
+        masks = {};
+        for (int i = 0; i < 4; ++i) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+            const int shift = 16 * i;
+            masks.quote |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)))) << shift;
+            masks.backslash |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)))) << shift;
+            const __m128i structural = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, open), _mm_cmpeq_epi8(v, close)),
+                                                    _mm_cmpeq_epi8(v, assign));
+            masks.structural |= uint64_t(uint32_t(_mm_movemask_epi8(structural))) << shift;
+            const __m128i newline = _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr));
+            masks.newline |= uint64_t(uint32_t(_mm_movemask_epi8(newline))) << shift;
+        }
+    }
+
+#endif
+
+#ifdef PARSER_HAVE_AVX2
+
+    PARSER_TARGET_AVX2 void ClassifyAvx2(const char *block, BlockMasks &masks) {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i open = _mm256_set1_epi8('{');
+        const __m256i close = _mm256_set1_epi8('}');
+        const __m256i assign = _mm256_set1_epi8('=');
+        const __m256i lf = _mm256_set1_epi8('\n');
+        const __m256i cr = _mm256_set1_epi8('\r');
+
+        masks = {};
+        for (int i = 0; i < 2; ++i) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32 * i));
+            const int shift = 32 * i;
+            masks.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)))) << shift;
+            masks.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)))) << shift;
+            const __m256i structural = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, open), _mm256_cmpeq_epi8(v, close)),
+                    _mm256_cmpeq_epi8(v, assign));
+            masks.structural |= uint64_t(uint32_t(_mm256_movemask_epi8(structural))) << shift;
+            const __m256i newline = _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr));
+            masks.newline |= uint64_t(uint32_t(_mm256_movemask_epi8(newline))) << shift;
+        }
+    }
+
+#endif
+
+    bool IsKernelSupported(ScanKernel kernel) {
+        switch (kernel) {
+            case ScanKernel::Scalar:
+                return true;
+            case ScanKernel::Sse2:
+#ifdef PARSER_HAVE_SSE2
+                return true;
+#else
+                return false;
+#endif
+            case ScanKernel::Avx2:
+#if defined(PARSER_HAVE_AVX2) && defined(__GNUC__)
+                return __builtin_cpu_supports("avx2");
+#elif defined(PARSER_HAVE_AVX2)
+                return true;
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    ScanKernel BestScanKernel() {
+        static const ScanKernel best = IsKernelSupported(ScanKernel::Avx2) ? ScanKernel::Avx2
+                                       : IsKernelSupported(ScanKernel::Sse2) ? ScanKernel::Sse2
+                                       : ScanKernel::Scalar;
+        return best;
+    }
+
+    StructuralScanner::StructuralScanner(std::string_view input, ScanKernel kernel)
+            : input_(input), classify_(ClassifyScalar) {
+        if (!IsKernelSupported(kernel)) {
+            kernel = ScanKernel::Scalar;
+        }
+#ifdef PARSER_HAVE_SSE2
+        if (kernel == ScanKernel::Sse2) {
+            classify_ = ClassifySse2;
+        }
+#endif
+#ifdef PARSER_HAVE_AVX2
+        if (kernel == ScanKernel::Avx2) {
+            classify_ = ClassifyAvx2;
+        }
+#endif
+    }
+
+    bool StructuralScanner::Done() const {
+        return pos_ == input_.size();
+    }
+
+    void StructuralScanner::ScanBlock(const char *block, uint64_t base, std::vector<uint64_t> &structurals,
+                                      std::vector<uint64_t> &specials) {
+        BlockMasks masks;
+        classify_(block, masks);
+
+        // Экранированные символы. Обратные слэши редки, поэтому достаточно пройти по ним по порядку:
+        // слэш, который сам экранирован, следующий символ не экранирует
+        uint64_t escaped = prev_escaped_ ? 1 : 0;
+        prev_escaped_ = false;
+        for (uint64_t slashes = masks.backslash; slashes; slashes &= slashes - 1) {
+            const int i = TrailingZeros(slashes);
+            if ((escaped >> i) & 1) {
+                continue;
+            }
+            if (i == 63) {
+                prev_escaped_ = true;
+            } else {
+                escaped |= uint64_t{1} << (i + 1);
+            }
+        }
+
+        const uint64_t quotes = masks.quote & ~escaped;
+        const uint64_t inside = PrefixXor(quotes) ^ in_string_;
+        in_string_ = uint64_t{0} - (inside >> 63);
+
+        AppendPositions((masks.structural & ~inside) | quotes, base, structurals);
+        AppendPositions(masks.backslash | (masks.newline & inside), base, specials);
+    }
+
+    bool StructuralScanner::ScanChunk(std::vector<uint64_t> &structurals, std::vector<uint64_t> &specials,
+                                      size_t min_bytes) {
+        if (Done()) {
+            return false;
+        }
+        PARSER_STATS_PHASE(Tokenize);
+        const size_t chunk = std::max<size_t>(64, (min_bytes + 63) / 64 * 64);
+        const size_t end = std::min(input_.size(), pos_ + chunk);
+        PARSER_STATS_ADD(bytes_scanned, end - pos_);
+        for (; pos_ + 64 <= end; pos_ += 64) {
+            ScanBlock(input_.data() + pos_, pos_, structurals, specials);
+        }
+        if (pos_ < end) {
+            // неполный последний блок дополняется пробелами
+            char tail[64];
+            std::memset(tail, ' ', sizeof(tail));
+            std::memcpy(tail, input_.data() + pos_, end - pos_);
+            ScanBlock(tail, pos_, structurals, specials);
+            pos_ = end;
+        }
+        return true;
+    }
+
+    StructuralIndex BuildStructuralIndex(std::string_view input, ScanKernel kernel) {
+        StructuralIndex index;
+        StructuralScanner scanner(input, kernel);
+        while (scanner.ScanChunk(index.structurals, index.specials, 1024 * 1024)) {
+        }
+        return index;
+    }
+
+    IndexedLexer::IndexedLexer(std::string_view input, ScanKernel kernel)
+            : input_(input), scanner_(input, kernel) {
+    }
+
+    size_t IndexedLexer::Position() const {
+        return pos_;
+    }
+
+    bool IndexedLexer::Refill() {
+        // прочитанные позиции больше не нужны - память индекса ограничена порцией
+        if (structural_head_ == structurals_.size()) {
+            structurals_.clear();
+            structural_head_ = 0;
+        }
+        specials_.erase(specials_.begin(), specials_.begin() + static_cast<std::ptrdiff_t>(special_head_));
+        special_head_ = 0;
+        return scanner_.ScanChunk(structurals_, specials_);
+    }
+
+    uint64_t IndexedLexer::PopStructural() {
+        while (structural_head_ == structurals_.size()) {
+            if (!Refill()) {
+                return input_.size();
+            }
+        }
+        return structurals_[structural_head_++];
+    }
+
+    bool IndexedLexer::HasSpecials(uint64_t begin, uint64_t end) {
+        // позиции до end уже просканированы, так как end - найденная закрывающая кавычка
+        while (special_head_ < specials_.size() && specials_[special_head_] <= begin) {
+            ++special_head_;
+        }
+        return special_head_ < specials_.size() && specials_[special_head_] < end;
+    }
+
+    Token IndexedLexer::Next() {
+        while (pos_ < input_.size() && IsSpace(input_[pos_])) {
+            ++pos_;
+        }
+        if (pos_ == input_.size()) {
+            return {TokenType::End, {}};
+        }
+        const char c = input_[pos_];
+        switch (c) {
+            case '=':
+            case '{':
+            case '}': {
+                if (PopStructural() != pos_) {
+                    return {TokenType::Invalid, input_.substr(pos_, 1)};
+                }
+                const TokenType type = c == '=' ? TokenType::Assign
+                                       : c == '{' ? TokenType::ListBegin
+                                       : TokenType::ListEnd;
+                return {type, input_.substr(pos_++, 1)};
+            }
+            case ',':
+                return {TokenType::Separator, input_.substr(pos_++, 1)};
+            case '"':
+                return ReadString();
+            default:
+                if (IsNameStart(c)) {
+                    const size_t begin = pos_;
+                    while (pos_ < input_.size() && IsNameChar(input_[pos_])) {
+                        ++pos_;
+                    }
+                    return {TokenType::Name, input_.substr(begin, pos_ - begin)};
+                }
+                return {TokenType::Invalid, input_.substr(pos_, 1)};
+        }
+    }
+
+    Token IndexedLexer::ReadString() {
+        const uint64_t open = PopStructural();
+        if (open != pos_) {
+            return {TokenType::Invalid, input_.substr(pos_, 1)};
+        }
+        // внутри строки структурных символов нет, следующая позиция - закрывающая кавычка
+        const uint64_t close = PopStructural();
+        if (close >= input_.size()) {
+            return {TokenType::Invalid, {}};
+        }
+        const std::string_view raw = input_.substr(open + 1, close - open - 1);
+        pos_ = close + 1;
+        if (!HasSpecials(open, close)) {
+            return {TokenType::String, raw};
+        }
+        if (!Unescape(raw, unescaped_)) {
+            return {TokenType::Invalid, raw};
+        }
+        return {TokenType::String, unescaped_};
+    }
+
+} //namespace parser
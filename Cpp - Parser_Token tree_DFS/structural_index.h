@@ -0,0 +1,103 @@
+#pragma once
+
+#include "lexer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace parser {
+
+    // Реализация первого прохода: векторная (SSE2/AVX2) или скалярная
+    enum class ScanKernel {
+        Scalar,
+        Sse2,
+        Avx2
+    };
+
+    // Самая быстрая реализация, доступная на текущем процессоре
+    ScanKernel BestScanKernel();
+
+    bool IsKernelSupported(ScanKernel kernel);
+
+    // Первый проход разбора. Вход обрабатывается блоками по 64 байта: векторные сравнения дают
+    // битовые маски кавычек, обратных слэшей и символов { } =, по маскам вычисляются
+    // экранированные символы и области строк. Результат - структурный индекс:
+    //   structurals - позиции { } = вне строк и всех неэкранированных кавычек (открывающих и закрывающих);
+    //   specials    - позиции всех обратных слэшей и переводов строки внутри строк (для раскодирования и проверки).
+    // Вход сканируется порциями, поэтому индекс можно строить и потреблять по частям
+    class StructuralScanner {
+    public:
+        explicit StructuralScanner(std::string_view input, ScanKernel kernel = BestScanKernel());
+
+        // Сканирует следующую порцию входа (не меньше min_bytes, кратно 64 байтам),
+        // дописывая найденные позиции по возрастанию. false - вход закончился
+        bool ScanChunk(std::vector<uint64_t> &structurals, std::vector<uint64_t> &specials,
+                       size_t min_bytes = 64 * 1024);
+
+        bool Done() const;
+
+        // битовые маски одного блока из 64 байт
+        struct BlockMasks {
+            uint64_t quote = 0;
+            uint64_t backslash = 0;
+            uint64_t structural = 0;   // { } =
+            uint64_t newline = 0;      // \n \r
+        };
+
+    private:
+        using ClassifyFn = void (*)(const char *block, BlockMasks &masks);
+
+        void ScanBlock(const char *block, uint64_t base, std::vector<uint64_t> &structurals,
+                       std::vector<uint64_t> &specials);
+
+        std::string_view input_;
+        size_t pos_ = 0;
+        ClassifyFn classify_;
+        bool prev_escaped_ = false;   // последний символ предыдущего блока - неэкранированный '\'
+        uint64_t in_string_ = 0;      // все единицы, если предыдущий блок закончился внутри строки
+    };
+
+    struct StructuralIndex {
+        std::vector<uint64_t> structurals;
+        std::vector<uint64_t> specials;
+    };
+
+    // Индекс всего входа целиком
+    StructuralIndex BuildStructuralIndex(std::string_view input, ScanKernel kernel = BestScanKernel());
+
+    // Второй проход: лексер, который берет позиции структурных символов и границы строк из индекса,
+    // а не ищет их посимвольно. Лексемы те же, что у Lexer. Индекс строится порциями по мере чтения,
+    // поэтому память под него ограничена размером порции
+    class IndexedLexer {
+    public:
+        explicit IndexedLexer(std::string_view input, ScanKernel kernel = BestScanKernel());
+
+        Token Next();
+
+        size_t Position() const;
+
+    private:
+        // следующая позиция структурного символа, input_.size() - позиций больше нет
+        uint64_t PopStructural();
+
+        // есть ли обратный слэш или перевод строки в промежутке (begin, end)
+        bool HasSpecials(uint64_t begin, uint64_t end);
+
+        bool Refill();
+
+        Token ReadString();
+
+        std::string_view input_;
+        size_t pos_ = 0;
+        StructuralScanner scanner_;
+        std::vector<uint64_t> structurals_;
+        size_t structural_head_ = 0;
+        std::vector<uint64_t> specials_;
+        size_t special_head_ = 0;
+        std::string unescaped_;
+    };
+
+} //namespace parser
@@ -0,0 +1,97 @@
+#include "symbol_table.h"
+
+#include <mutex>
+#include <shared_mutex>
+
+namespace parser {
+
+    SymbolTable::SymbolTable(const SymbolTable &other) {
+        for (const std::string &text: other.strings_) {
+            Intern(text);
+        }
+    }
+
+    SymbolTable &SymbolTable::operator=(const SymbolTable &other) {
+        if (this != &other) {
+            SymbolTable copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    uint32_t SymbolTable::Intern(std::string_view text) {
+        const auto it = ids_.find(text);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+        const auto id = static_cast<uint32_t>(strings_.size());
+        strings_.emplace_back(text);
+        ids_.emplace(strings_.back(), id);
+        return id;
+    }
+
+    uint32_t SymbolTable::Find(std::string_view text) const {
+        const auto it = ids_.find(text);
+        return it == ids_.end() ? kNoSymbol : it->second;
+    }
+
+    const std::string &SymbolTable::Get(uint32_t id) const {
+        return strings_.at(id);
+    }
+
+    size_t SymbolTable::Size() const {
+        return strings_.size();
+    }
+
+    SymbolTable &NameTables::Add() {
+        return tables_.emplace_back();
+    }
+
+    SymbolTable &NameTables::Front() {
+        if (tables_.empty()) {
+            return Add();
+        }
+        return tables_.front();
+    }
+
+    size_t NameTables::Size() const {
+        size_t size = 0;
+        for (const SymbolTable &table: tables_) {
+            size += table.Size();
+        }
+        return size;
+    }
+
+    namespace {
+
+        SymbolTable &SharedNames() {
+            static SymbolTable names;
+            return names;
+        }
+
+        std::shared_mutex &SharedNamesMutex() {
+            static std::shared_mutex mutex;
+            return mutex;
+        }
+
+    } // namespace
+
+    const std::string &InternName(std::string_view name) {
+        SymbolTable &names = SharedNames();
+        {
+            std::shared_lock lock(SharedNamesMutex());
+            const uint32_t id = names.Find(name);
+            if (id != SymbolTable::kNoSymbol) {
+                return names.Get(id);
+            }
+        }
+        std::unique_lock lock(SharedNamesMutex());
+        return names.Get(names.Intern(name));
+    }
+
+    size_t InternedNameCount() {
+        std::shared_lock lock(SharedNamesMutex());
+        return SharedNames().Size();
+    }
+
+} //namespace parser
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace parser {
+
+    // Таблица символов: каждая различная строка хранится один раз и получает 32-битный id
+    // (по порядку добавления, с нуля). Строки не перемещаются, ссылки на них действительны,
+    // пока жива таблица
+    class SymbolTable {
+    public:
+        static constexpr uint32_t kNoSymbol = UINT32_MAX;
+
+        SymbolTable() = default;
+
+        // ключи индекса ссылаются на строки таблицы, поэтому у копии индекс строится заново
+        SymbolTable(const SymbolTable &other);
+
+        SymbolTable &operator=(const SymbolTable &other);
+
+        SymbolTable(SymbolTable &&) = default;
+
+        SymbolTable &operator=(SymbolTable &&) = default;
+
+        // id строки; новая строка добавляется в таблицу
+        uint32_t Intern(std::string_view text);
+
+        // id строки или kNoSymbol, если ее нет в таблице
+        uint32_t Find(std::string_view text) const;
+
+        const std::string &Get(uint32_t id) const;
+
+        size_t Size() const;
+
+    private:
+        std::deque<std::string> strings_;
+        std::unordered_map<std::string_view, uint32_t> ids_;
+    };
+
+    // Имена узлов одного документа. Узел хранит указатель на строку таблицы, поэтому таблицы живут,
+    // пока жив документ или хотя бы одна его копия (владение общее), и освобождаются вместе с ними.
+    // Таблица не потокобезопасна: параллельный разбор заводит отдельную таблицу на каждую часть
+    class NameTables {
+    public:
+        // новая пустая таблица; ссылки на прежние таблицы остаются действительны
+        SymbolTable &Add();
+
+        // первая таблица, в нее добавляются имена при правке документа
+        SymbolTable &Front();
+
+        // число имен во всех таблицах
+        size_t Size() const;
+
+    private:
+        std::deque<SymbolTable> tables_;
+    };
+
+    // Общая таблица имен для узлов, построенных вручную (SetName без таблицы документа).
+    // Разобранные документы в нее не пишут, поэтому она растет только от имен, заданных в коде,
+    // а не от входных данных. Имена не удаляются. Потокобезопасна
+    const std::string &InternName(std::string_view name);
+
+    // число имен в общей таблице
+    size_t InternedNameCount();
+
+} //namespace parser
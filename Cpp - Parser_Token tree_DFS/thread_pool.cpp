@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <utility>
+
+namespace parser {
+
+    size_t DefaultThreadCount() {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    ThreadPool &ThreadPool::Shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        ready_.notify_all();
+        for (auto &worker: workers_) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::Reserve(size_t workers) {
+        std::lock_guard lock(mutex_);
+        while (workers_.size() < workers) {
+            workers_.emplace_back([this] { Run(); });
+        }
+    }
+
+    void ThreadPool::Submit(std::function<void()> task) {
+#ifdef PARSER_STATS
+        // статистика задачи идет в счетчики отправившего потока
+        task = [stats = stats_detail::Current(), task = std::move(task)] {
+            stats_detail::ScopedCounters scoped(stats);
+            task();
+        };
+#endif
+        {
+            std::lock_guard lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        ready_.notify_one();
+    }
+
+    void ThreadPool::Run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex_);
+                ready_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                if (stop_) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    void ParallelFor(size_t count, size_t threads, const std::function<void(size_t)> &task) {
+        // Состояние общее с задачами пула: задача может начаться уже после возврата из ParallelFor,
+        // тогда она не находит свободных номеров и к task не обращается
+        struct State {
+            const std::function<void(size_t)> *task;
+            size_t count;
+            std::atomic<size_t> next{0};
+            std::vector<std::exception_ptr> errors;
+            std::mutex mutex;
+            std::condition_variable finished;
+            size_t done = 0;
+        };
+        auto state = std::make_shared<State>();
+        state->task = &task;
+        state->count = count;
+        state->errors.resize(count);
+
+        auto work = [](State &s) {
+            size_t completed = 0;
+            for (size_t i = s.next++; i < s.count; i = s.next++) {
+                try {
+                    (*s.task)(i);
+                } catch (...) {
+                    s.errors[i] = std::current_exception();
+                }
+                ++completed;
+            }
+            if (completed) {
+                std::lock_guard lock(s.mutex);
+                s.done += completed;
+                if (s.done == s.count) {
+                    s.finished.notify_all();
+                }
+            }
+        };
+
+        // вызывающий поток тоже работает, потоков пула - не больше, чем остальных задач
+        const size_t extra = std::min(std::max<size_t>(threads, 1), count) - (count ? 1 : 0);
+        if (extra) {
+            ThreadPool &pool = ThreadPool::Shared();
+            pool.Reserve(extra);
+            for (size_t i = 0; i < extra; ++i) {
+                pool.Submit([state, work] { work(*state); });
+            }
+        }
+        work(*state);
+        {
+            std::unique_lock lock(state->mutex);
+            state->finished.wait(lock, [&] { return state->done == count; });
+        }
+
+        for (const auto &error: state->errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+} //namespace parser
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parser {
+
+    // Число потоков по умолчанию - число аппаратных потоков (не меньше одного)
+    size_t DefaultThreadCount();
+
+    // Пул рабочих потоков на всю программу: потоки создаются при первой надобности и живут до выхода,
+    // поэтому параллельные функции не платят за создание потоков на каждом вызове.
+    // Задачи выполняются в порядке отправки, статистика задачи идет в счетчики отправившего потока
+    class ThreadPool {
+    public:
+        static ThreadPool &Shared();
+
+        ThreadPool() = default;
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // дожидается текущих задач, не начатые задачи отбрасываются
+        ~ThreadPool();
+
+        // пул дорастает до workers потоков (и не уменьшается)
+        void Reserve(size_t workers);
+
+        // Задача не должна бросать исключений. Задача может начаться позже, чем ожидает отправитель,
+        // поэтому она не должна ссылаться на данные, которые отправитель не держит до ее завершения
+        void Submit(std::function<void()> task);
+
+    private:
+        void Run();
+
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::deque<std::function<void()>> tasks_;
+        std::vector<std::thread> workers_;
+        bool stop_ = false;
+    };
+
+    // Выполняет task(i) для всех i из [0, count) в вызывающем потоке и не более чем threads - 1
+    // потоках общего пула. Потоки разбирают номера задач по очереди, поэтому задачи разного размера
+    // балансируются сами. Вызывающий поток тоже разбирает номера, поэтому вложенный вызов из задачи
+    // пула завершается, даже если все потоки пула заняты.
+    // Исключение из задачи перебрасывается в вызывающий поток (с наименьшим номером задачи),
+    // остальные задачи при этом все равно выполняются
+    void ParallelFor(size_t count, size_t threads, const std::function<void(size_t)> &task);
+
+} //namespace parser